@@ -0,0 +1,213 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aho.h"
+
+struct pattern {
+    char *s;
+    size_t len;
+    int value;
+};
+
+struct aho {
+    int ignore_case;
+    struct pattern *patterns; /* Until built. */
+    int n_patterns;
+    unsigned char cls[256];   /* Input class of each byte. */
+    int n_classes;
+    int *delta;               /* n_nodes rows of n_classes transitions. */
+    int *best;                /* Lowest value matched when in a node. */
+    int n_nodes;
+};
+
+static int lower(const struct aho *aho, unsigned char c)
+{
+    return aho->ignore_case ? tolower(c) : c;
+}
+
+/* The lower of two values, where -1 means none. */
+static int min_value(int a, int b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
+static void free_patterns(struct aho *aho)
+{
+    int i;
+
+    for (i = 0; i < aho->n_patterns; i++)
+        free(aho->patterns[i].s);
+    free(aho->patterns);
+    aho->patterns = NULL;
+    aho->n_patterns = 0;
+}
+
+struct aho *aho_create(int ignore_case)
+{
+    struct aho *aho = calloc(1, sizeof(struct aho));
+
+    if (aho)
+        aho->ignore_case = ignore_case;
+
+    return aho;
+}
+
+void aho_free(struct aho *aho)
+{
+    if (!aho)
+        return;
+
+    free_patterns(aho);
+    free(aho->delta);
+    free(aho->best);
+    free(aho);
+}
+
+int aho_add(struct aho *aho, const char *s, size_t len, int value)
+{
+    struct pattern *p;
+
+    /* Powers of two. */
+    if (!(aho->n_patterns & (aho->n_patterns - 1))) {
+        p = realloc(aho->patterns,
+                    (aho->n_patterns ? 2 * aho->n_patterns : 1) *
+                        sizeof(struct pattern));
+        if (!p)
+            return -1;
+        aho->patterns = p;
+    }
+
+    p = &aho->patterns[aho->n_patterns];
+    p->s = malloc(len + 1);
+    if (!p->s)
+        return -1;
+    memcpy(p->s, s, len);
+    p->len = len;
+    p->value = value;
+    aho->n_patterns++;
+
+    return 0;
+}
+
+/* Number the bytes the patterns use; the rest stay in class 0. */
+static void assign_classes(struct aho *aho)
+{
+    size_t i;
+    int c, p;
+
+    memset(aho->cls, 0, sizeof(aho->cls));
+    aho->n_classes = 1;
+    for (p = 0; p < aho->n_patterns; p++) {
+        for (i = 0; i < aho->patterns[p].len; i++) {
+            c = lower(aho, aho->patterns[p].s[i]);
+            if (!aho->cls[c])
+                aho->cls[c] = aho->n_classes++;
+        }
+    }
+
+    if (aho->ignore_case)
+        for (c = 'A'; c <= 'Z'; c++)
+            aho->cls[c] = aho->cls[tolower(c)];
+}
+
+int aho_build(struct aho *aho)
+{
+    int *delta, *fail = NULL, *queue = NULL, nc, n, u, v, c, p, head, tail;
+    size_t i, max_nodes = 1;
+
+    assign_classes(aho);
+    nc = aho->n_classes;
+
+    for (p = 0; p < aho->n_patterns; p++)
+        max_nodes += aho->patterns[p].len;
+    free(aho->delta);
+    free(aho->best);
+    aho->delta = calloc(max_nodes * nc, sizeof(int));
+    aho->best = malloc(max_nodes * sizeof(int));
+    fail = malloc(max_nodes * sizeof(int));
+    queue = malloc(max_nodes * sizeof(int));
+    if (!aho->delta || !aho->best || !fail || !queue)
+        goto err;
+    delta = aho->delta;
+
+    /* The trie: 0 is the root, so it also means no child. */
+    n = 1;
+    aho->best[0] = -1;
+    for (p = 0; p < aho->n_patterns; p++) {
+        u = 0;
+        for (i = 0; i < aho->patterns[p].len; i++) {
+            c = aho->cls[(unsigned char)aho->patterns[p].s[i]];
+            if (!delta[u * nc + c]) {
+                aho->best[n] = -1;
+                delta[u * nc + c] = n++;
+            }
+            u = delta[u * nc + c];
+        }
+        aho->best[u] = min_value(aho->best[u], aho->patterns[p].value);
+    }
+
+    /*
+     * Breadth first, fill in the failure links and the missing
+     * transitions, from the already complete rows of shallower nodes.
+     */
+    fail[0] = 0;
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        u = queue[head++];
+        for (c = 0; c < nc; c++) {
+            v = delta[u * nc + c];
+            if (v) {
+                fail[v] = u ? delta[fail[u] * nc + c] : 0;
+                aho->best[v] = min_value(aho->best[v], aho->best[fail[v]]);
+                queue[tail++] = v;
+            } else {
+                delta[u * nc + c] = u ? delta[fail[u] * nc + c] : 0;
+            }
+        }
+    }
+
+    aho->n_nodes = n;
+    /* Fewer nodes than characters with shared prefixes. */
+    delta = realloc(aho->delta, n * nc * sizeof(int));
+    if (delta)
+        aho->delta = delta;
+    free(fail);
+    free(queue);
+    free_patterns(aho);
+
+    return 0;
+
+err:
+    free(fail);
+    free(queue);
+    free(aho->delta);
+    free(aho->best);
+    aho->delta = NULL;
+    aho->best = NULL;
+    return -1;
+}
+
+int aho_match(const struct aho *aho, const char *s, size_t len)
+{
+    const int *delta = aho->delta;
+    int nc = aho->n_classes, u = 0, best;
+    size_t i;
+
+    if (!delta)
+        return -1;
+
+    best = aho->best[0];
+    for (i = 0; i < len; i++) {
+        u = delta[u * nc + aho->cls[(unsigned char)s[i]]];
+        if (aho->best[u] >= 0)
+            best = min_value(best, aho->best[u]);
+    }
+
+    return best;
+}
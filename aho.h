@@ -0,0 +1,21 @@
+/*
+ * Aho-Corasick automaton: finds which of a set of strings occur in a text,
+ * as indexOf() would, in a single pass over the text. Bytes that occur in
+ * none of the strings share one input class, so the transition table
+ * stays small.
+ */
+struct aho;
+
+/* With ignore_case, ASCII letters match regardless of case. */
+struct aho *aho_create(int ignore_case);
+void aho_free(struct aho *aho);
+
+/*
+ * Add a string with a value, e.g. the index of the rule it comes from.
+ * All strings must be added before aho_build().
+ */
+int aho_add(struct aho *aho, const char *s, size_t len, int value);
+int aho_build(struct aho *aho);
+
+/* Lowest value of the strings occurring in s, or -1 if none. */
+int aho_match(const struct aho *aho, const char *s, size_t len);
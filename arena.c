@@ -0,0 +1,279 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#include <sys/mman.h>
+#endif
+
+#include "arena.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define HUGE_CHUNK_SIZE (2 * 1024 * 1024)
+
+/*
+ * Block sizes, including the header. Multiples of 16, so that payloads
+ * after the 8 byte header are 8 byte aligned, as Duktape requires.
+ */
+static const unsigned int class_size[] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+};
+
+#define N_CLASSES (sizeof(class_size) / sizeof(class_size[0]))
+#define MAX_CLASS_SIZE 2048
+#define LARGE N_CLASSES /* Class of blocks from malloc(). */
+
+struct header {
+    unsigned int size; /* As requested. */
+    unsigned int cls;
+};
+
+#define HDR sizeof(struct header)
+
+/* Free blocks reuse their payload as link. */
+struct free_block {
+    struct header hdr;
+    struct free_block *next;
+};
+
+struct chunk {
+    struct chunk *next;
+    size_t size;
+    int mapped;
+};
+
+/* Chunk header size, rounded up to keep blocks 16 byte aligned. */
+#define CHUNK_HDR ((sizeof(struct chunk) + 15) & ~(size_t)15)
+
+struct arena {
+    int huge_pages;
+    size_t limit;
+    struct chunk *chunks;
+    char *bump, *end; /* Unused part of the newest chunk. */
+    struct free_block *free[N_CLASSES];
+    struct arena_stats stats;
+};
+
+/* Size class for each block size up to MAX_CLASS_SIZE, in steps of 16. */
+static unsigned char class_of[MAX_CLASS_SIZE / 16 + 1];
+static pthread_once_t class_once = PTHREAD_ONCE_INIT;
+
+static void init_classes(void)
+{
+    unsigned int i, cls = 0;
+
+    for (i = 0; i <= MAX_CLASS_SIZE / 16; i++) {
+        while (class_size[cls] < i * 16)
+            cls++;
+        class_of[i] = cls;
+    }
+}
+
+struct arena *arena_create(int huge_pages)
+{
+    struct arena *arena;
+
+    pthread_once(&class_once, init_classes);
+
+    arena = calloc(1, sizeof(struct arena));
+    if (arena)
+        arena->huge_pages = huge_pages;
+
+    return arena;
+}
+
+void arena_destroy(struct arena *arena)
+{
+    struct chunk *c, *next;
+
+    for (c = arena->chunks; c; c = next) {
+        next = c->next;
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+        if (c->mapped) {
+            munmap(c, c->size);
+            continue;
+        }
+#endif
+        free(c);
+    }
+
+    free(arena);
+}
+
+void arena_get_stats(struct arena *arena, struct arena_stats *stats)
+{
+    *stats = arena->stats;
+}
+
+void arena_set_limit(struct arena *arena, size_t limit)
+{
+    arena->limit = limit;
+}
+
+static int over_limit(struct arena *arena, size_t grow)
+{
+    if (!arena->limit || arena->stats.bytes_live + grow <= arena->limit)
+        return 0;
+
+    arena->stats.refused++;
+    return 1;
+}
+
+static struct chunk *map_chunk(size_t size)
+{
+#if !defined(_WIN32) && !defined(__CYGWIN__) && defined(MAP_ANONYMOUS)
+    void *p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+        /* No huge pages reserved: ask for transparent ones instead. */
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+#if defined(MADV_HUGEPAGE)
+        madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+    ((struct chunk *)p)->mapped = 1;
+    return p;
+#else
+    return NULL;
+#endif
+}
+
+static int new_chunk(struct arena *arena)
+{
+    struct chunk *c = NULL;
+    size_t size = CHUNK_SIZE;
+
+    if (arena->huge_pages) {
+        size = HUGE_CHUNK_SIZE;
+        c = map_chunk(size);
+    }
+    if (!c) {
+        c = malloc(size);
+        if (!c)
+            return -1;
+        c->mapped = 0;
+    }
+
+    c->size = size;
+    c->next = arena->chunks;
+    arena->chunks = c;
+    arena->bump = (char *)c + CHUNK_HDR;
+    arena->end = (char *)c + size;
+    arena->stats.chunk_bytes += size;
+
+    return 0;
+}
+
+static void *alloc_block(struct arena *arena, size_t size)
+{
+    struct header *h;
+    unsigned int cls;
+
+    if (size + HDR > MAX_CLASS_SIZE) {
+        h = malloc(size + HDR);
+        if (!h)
+            return NULL;
+        cls = LARGE;
+    } else {
+        cls = class_of[(size + HDR + 15) / 16];
+        if (arena->free[cls]) {
+            h = &arena->free[cls]->hdr;
+            arena->free[cls] = arena->free[cls]->next;
+        } else {
+            if (arena->end - arena->bump < (long)class_size[cls] &&
+                new_chunk(arena) < 0)
+                return NULL;
+            h = (struct header *)arena->bump;
+            arena->bump += class_size[cls];
+        }
+    }
+
+    h->size = size;
+    h->cls = cls;
+
+    arena->stats.allocs++;
+    arena->stats.bytes_live += size;
+    if (arena->stats.bytes_live > arena->stats.bytes_peak)
+        arena->stats.bytes_peak = arena->stats.bytes_live;
+
+    return h + 1;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    if (size == 0 || over_limit(arena, size))
+        return NULL;
+
+    return alloc_block(arena, size);
+}
+
+void arena_free(struct arena *arena, void *ptr)
+{
+    struct header *h;
+    struct free_block *fb;
+
+    if (!ptr)
+        return;
+
+    h = (struct header *)ptr - 1;
+    arena->stats.bytes_live -= h->size;
+
+    if (h->cls == LARGE) {
+        free(h);
+        return;
+    }
+
+    fb = (struct free_block *)h;
+    fb->next = arena->free[h->cls];
+    arena->free[h->cls] = fb;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr, size_t size)
+{
+    struct header *h;
+    void *p;
+
+    if (!ptr)
+        return arena_alloc(arena, size);
+    if (size == 0) {
+        arena_free(arena, ptr);
+        return NULL;
+    }
+
+    h = (struct header *)ptr - 1;
+    if (size > h->size && over_limit(arena, size - h->size))
+        return NULL;
+
+    if (h->cls == LARGE && size + HDR > MAX_CLASS_SIZE) {
+        p = realloc(h, size + HDR);
+        if (!p)
+            return NULL;
+        h = p;
+    } else if (h->cls != LARGE && size + HDR <= class_size[h->cls]) {
+        /* Still fits. */
+    } else {
+        p = alloc_block(arena, size);
+        if (!p)
+            return NULL;
+        memcpy(p, ptr, h->size < size ? h->size : size);
+        arena_free(arena, ptr);
+        return p;
+    }
+
+    arena->stats.allocs++;
+    arena->stats.bytes_live += size;
+    arena->stats.bytes_live -= h->size;
+    if (arena->stats.bytes_live > arena->stats.bytes_peak)
+        arena->stats.bytes_peak = arena->stats.bytes_live;
+    h->size = size;
+
+    return h + 1;
+}
@@ -0,0 +1,29 @@
+/*
+ * Per-heap allocator for JS contexts. Small blocks are carved from large
+ * chunks and recycled via free lists per size class; larger ones go to
+ * malloc(). Not thread safe: a heap is only used by one thread at a time.
+ */
+struct arena;
+
+struct arena_stats {
+    unsigned long bytes_live; /* Requested sizes of allocated blocks. */
+    unsigned long bytes_peak;
+    unsigned long allocs;     /* Allocations so far, including reallocs. */
+    unsigned long chunk_bytes; /* Memory taken from the system for chunks. */
+    unsigned long refused;    /* Allocations failed because of the limit. */
+};
+
+/*
+ * If huge_pages is set, chunks are 2 MB huge pages where the system
+ * provides them, and transparent huge pages are requested otherwise.
+ */
+struct arena *arena_create(int huge_pages);
+void arena_destroy(struct arena *arena);
+void arena_get_stats(struct arena *arena, struct arena_stats *stats);
+/* Fail allocations that would bring bytes_live over limit (0: none). */
+void arena_set_limit(struct arena *arena, size_t limit);
+
+/* Same semantics as the allocation functions of duk_create_heap(). */
+void *arena_alloc(struct arena *arena, size_t size);
+void *arena_realloc(struct arena *arena, void *ptr, size_t size);
+void arena_free(struct arena *arena, void *ptr);
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+
+#include "bloom.h"
+
+/* 512 bit blocks, of which each hash sets K. */
+#define BLOCK_WORDS 8
+#define K 6
+#define BITS_PER_KEY 10
+
+struct bloom {
+    unsigned long long (*blocks)[BLOCK_WORDS];
+    unsigned int n_blocks;
+};
+
+struct bloom *bloom_create(unsigned int n)
+{
+    struct bloom *bloom = calloc(1, sizeof(struct bloom));
+
+    if (!bloom)
+        return NULL;
+
+    bloom->n_blocks = (n * BITS_PER_KEY + 64 * BLOCK_WORDS - 1) /
+                      (64 * BLOCK_WORDS);
+    if (!bloom->n_blocks)
+        bloom->n_blocks = 1;
+    bloom->blocks = calloc(bloom->n_blocks, sizeof(*bloom->blocks));
+    if (!bloom->blocks) {
+        free(bloom);
+        return NULL;
+    }
+
+    return bloom;
+}
+
+void bloom_free(struct bloom *bloom)
+{
+    if (!bloom)
+        return;
+
+    free(bloom->blocks);
+    free(bloom);
+}
+
+/*
+ * The high 32 bits pick the block, and the low ones the bits in it, as
+ * a + i * b for two 16 bit numbers.
+ */
+static int bit(unsigned long long hash, int i)
+{
+    return ((hash & 0xffff) + i * (((hash >> 16) & 0xffff) | 1)) & 511;
+}
+
+void bloom_add(struct bloom *bloom, unsigned long long hash)
+{
+    unsigned long long *block = bloom->blocks[(hash >> 32) % bloom->n_blocks];
+    int i, b;
+
+    for (i = 0; i < K; i++) {
+        b = bit(hash, i);
+        block[b / 64] |= 1ull << (b % 64);
+    }
+}
+
+int bloom_maybe(const struct bloom *bloom, unsigned long long hash)
+{
+    const unsigned long long *block =
+        bloom->blocks[(hash >> 32) % bloom->n_blocks];
+    int i, b;
+
+    for (i = 0; i < K; i++) {
+        b = bit(hash, i);
+        if (!(block[b / 64] & (1ull << (b % 64))))
+            return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,15 @@
+/*
+ * Blocked Bloom filter: a set of 64 bit hashes that may answer "maybe"
+ * for one that was never added, but never "no" for one that was. All the
+ * bits of a hash lie in one 64 byte block, so a test touches a single
+ * cache line. The caller hashes the keys, with a well mixed 64 bit hash.
+ */
+struct bloom;
+
+/* Sized for n hashes, at about 1% false positives. */
+struct bloom *bloom_create(unsigned int n);
+void bloom_free(struct bloom *bloom);
+
+void bloom_add(struct bloom *bloom, unsigned long long hash);
+/* 0 if hash was certainly never added. */
+int bloom_maybe(const struct bloom *bloom, unsigned long long hash);
@@ -3011,6 +3011,66 @@ typedef struct duk_hthread duk_context;
 
 /* __OVERRIDE_DEFINES__ */
 
+/*
+ *  libpac: let pac.c abort running evaluations (cancelled or past their
+ *  deadline) from the executor interrupt, see pac_exec_timeout_check().
+ */
+#define DUK_USE_INTERRUPT_COUNTER
+#define DUK_USE_EXEC_TIMEOUT_CHECK(udata) pac_exec_timeout_check((udata))
+#undef DUK_USE_USER_DECLARE
+#define DUK_USE_USER_DECLARE() \
+	extern duk_bool_t pac_exec_timeout_check(void *udata);
+
+/*
+ *  libpac: with --disable-voluntary-gc, mark-and-sweep only runs between
+ *  lookups (see maybe_gc() in pac.c) or when an allocation fails.
+ *  Reference counting still frees non-cyclic garbage right away.
+ */
+#if defined(PAC_NO_VOLUNTARY_GC)
+#undef DUK_USE_VOLUNTARY_GC
+#endif
+
+/*
+ *  libpac: with --enable-fastint, numbers that fit are kept as 48-bit
+ *  integers, which speeds up the bit operations of the address helpers
+ *  (convert_addr(), isInNet()).  Needs 64-bit integer support.
+ */
+#if defined(PAC_FASTINT) && defined(DUK_USE_64BIT_OPS)
+#define DUK_USE_FASTINT
+#endif
+
+/*
+ *  libpac: with --enable-light-builtins, built-in functions without
+ *  properties of their own (most of them) are lightfuncs, which live in
+ *  the value that refers to them rather than in the heap.  Makes every
+ *  heap about a third smaller, at the cost of non-standard behavior of
+ *  such functions (e.g. their name, and properties can't be added).
+ */
+#if defined(PAC_LIGHT_BUILTINS)
+#define DUK_USE_LIGHTFUNC_BUILTINS
+#endif
+
+/*
+ *  libpac: --with-duktape-profile=minimal drops what PAC scripts don't
+ *  need (and implies --enable-fastint and --enable-light-builtins).
+ *  Errors get no tracebacks, and no Duktape.errCreate/errThrow hooks.
+ *  The built-in objects themselves (JSON, Proxy, buffers) stay:
+ *  their tables were generated into duktape.c by configure.py, and
+ *  removing them takes a rerun of it.
+ */
+#if defined(PAC_DUK_MINIMAL)
+#undef DUK_USE_AUGMENT_ERROR_CREATE
+#undef DUK_USE_AUGMENT_ERROR_THROW
+#undef DUK_USE_COMMONJS_MODULES
+#undef DUK_USE_DEBUGGER_THROW_NOTIFY
+#undef DUK_USE_ERRCREATE
+#undef DUK_USE_ERRTHROW
+#undef DUK_USE_FUNC_FILENAME_PROPERTY
+#undef DUK_USE_JC
+#undef DUK_USE_JX
+#undef DUK_USE_TRACEBACKS
+#endif
+
 /*
  *  Date provider selection
  *
@@ -0,0 +1,105 @@
+/*
+ * Build tool for configure --with-rom-pac: compiles a PAC script, and
+ * writes C source defining it as struct pac_rom to stdout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rom.h"
+
+/* mkrom links the library without a built-in script. */
+const struct pac_rom pac_rom;
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    char *buf = NULL, *p;
+    size_t len = 0, n;
+
+    if (!f)
+        return NULL;
+
+    for (;;) {
+        p = realloc(buf, len + 4096 + 1);
+        if (!p) {
+            free(buf);
+            fclose(f);
+            return NULL;
+        }
+        buf = p;
+        n = fread(buf + len, 1, 4096, f);
+        len += n;
+        if (n < 4096)
+            break;
+    }
+    buf[len] = '\0';
+    fclose(f);
+
+    return buf;
+}
+
+static void print_bytes(const char *name, const unsigned char *bytes,
+                        size_t len)
+{
+    size_t i;
+
+    printf("static const unsigned char %s[] = {", name);
+    for (i = 0; i < len; i++)
+        printf("%s%u,", i % 16 ? "" : "\n    ", bytes[i]);
+    printf("\n};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned char *bytecode, *rules_bytecode = NULL;
+    size_t len, rules_len = 0;
+    char *js;
+    int ret;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <pac file>\n", argv[0]);
+        return 2;
+    }
+
+    js = read_file(argv[1]);
+    if (!js) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if (pac_compile_rom(js, 0, &bytecode, &len) < 0) {
+        fprintf(stderr, "%s: failed to compile\n", argv[1]);
+        return 1;
+    }
+    ret = pac_compile_rom(js, 1, &rules_bytecode, &rules_len);
+    if (ret < 0) {
+        fprintf(stderr, "%s: failed to compile with rules\n", argv[1]);
+        return 1;
+    }
+
+    printf("/* Generated by mkrom from %s. */\n\n", argv[1]);
+    printf("#include <stddef.h>\n\n#include \"rom.h\"\n\n");
+    /* As bytes, to keep it as it is, whatever it contains. */
+    print_bytes("javascript", (const unsigned char *)js, strlen(js) + 1);
+    print_bytes("bytecode", bytecode, len);
+    if (ret == 0)
+        print_bytes("rules_bytecode", rules_bytecode, rules_len);
+    printf("const struct pac_rom pac_rom = {\n"
+           "    (const char *)javascript,\n"
+           "    bytecode,\n"
+           "    sizeof(bytecode),\n");
+    if (ret == 0)
+        printf("    rules_bytecode,\n"
+               "    sizeof(rules_bytecode),\n");
+    else
+        printf("    NULL,\n"
+               "    0,\n");
+    printf("};\n");
+
+    free(js);
+    free(bytecode);
+    free(rules_bytecode);
+
+    return fflush(stdout) == 0 ? 0 : 1;
+}
@@ -1,7 +1,9 @@
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -14,7 +16,13 @@
 #include "duktape.h"
 #include "threadpool.h"
 
+#include "aho.h"
+#include "arena.h"
 #include "nsProxyAutoConfig.h"
+#include "radix.h"
+#include "rom.h"
+#include "rules.h"
+#include "suffix.h"
 #include "util.h"
 
 #include "pac.h"
@@ -28,21 +36,180 @@
 #define RETURN_SINGLE_RESULT 0
 #define RETURN_ALL_RESULTS 1
 
+/*
+ * Number of hosts whose lane (whether looking them up resolved names last
+ * time) is remembered. Must be a power of two.
+ */
+#define HOST_LANES 4096
+
+/*
+ * Buckets of the tables of pending lookups, by handle and by (url, host).
+ * Power of two.
+ */
+#define REQ_BUCKETS 1024
+
+/* Buckets of the table of scripts by ID. Power of two. */
+#define TENANT_BUCKETS 256
+
+struct proxy_args;
+
+/*
+ * A version of the PAC script. It is compiled once, and its bytecode is
+ * loaded into every context running it.
+ */
+struct pac_script {
+    char *javascript;
+    void *bytecode;
+    size_t bytecode_len;
+    struct rules *rules; /* Compiled rules, or NULL. */
+    int rom;     /* javascript and bytecode are pac_rom's. */
+    int refs;    /* Contexts built from it, plus its tenant. */
+    int retired; /* Replaced or removed: free its contexts when idle. */
+};
+
+/*
+ * A script addressed by ID, or the one passed to pac_init_opts(), which
+ * has none. Stays the same across reloads; script is the current version.
+ */
+struct tenant {
+    char *id;
+    struct pac_script *script; /* NULL if there is none (any more). */
+    int refs;                  /* pac->tenants, plus lookups for it. */
+    struct tenant *next;       /* In pac->tenants. */
+};
+
+/* A JS context, and the NUMA node its heap was first touched on. */
+struct pac_ctx {
+    duk_context *ctx;
+    int node;
+    struct pac_script *script;
+    struct pac_ctx *next; /* In pac->idle, most recently used first. */
+    int resolved; /* The current lookup called dnsResolve(). */
+    struct proxy_args *req; /* Lookup being evaluated, or NULL. */
+    unsigned long long budget_end; /* util_now_ms() based, or 0. */
+    int over_budget; /* The current evaluation ran out of time. */
+    int interrupted; /* An evaluation was aborted: don't reuse. */
+    struct arena *arena; /* Allocator of the heap, or NULL for malloc(). */
+    int since_gc; /* Lookups since the last collection. */
+    unsigned long gc_count, gc_last_us, gc_max_us;
+    int slot;  /* Index passed to build_ctx_for_slot(), or -1. */
+    int evals; /* Lookups evaluated so far. */
+    unsigned long base_bytes; /* Heap size after loading the script. */
+    /* Spare: the worn out context it was built for, or NULL for any. */
+    struct pac_ctx *replaces;
+    int parked;   /* Lookups suspended in its coroutines. */
+    int draining; /* Freed once its parked lookups are done. */
+    unsigned int next_co; /* Last coroutine ID handed out. */
+    int my_ip_ttl_ms; /* See pac_opts.my_ip_ttl_ms. */
+    int coroutines; /* Lookups run in coroutines, see resolver_threads. */
+};
+
+struct host_lane {
+    unsigned int hash;
+    int lane;
+};
+
 struct pac {
-    char *javascript; /* JavaScript PAC code. */
-    threadpool_t *threadpool;
+    threadpool_t *threadpool;     /* Fast lane. */
+    threadpool_t *dns_threadpool; /* DNS lane, or NULL if not in use. */
+    threadpool_t *resolver_pool;  /* Resolver threads, or NULL. */
+    pthread_mutex_t dns_mtx;      /* Protects the state of DNS queries. */
+    pthread_cond_t dns_cond;      /* Signalled when a query is answered. */
+    pthread_mutex_t lane_mtx;
+    struct host_lane host_lanes[HOST_LANES];
+    pthread_mutex_t req_mtx; /* Protects the fields below, and waiters. */
+    unsigned int generation; /* Bumped by pac_reload(). */
+    unsigned long next_handle;
+    struct waiter *reqs[REQ_BUCKETS];
+    struct proxy_args *inflight[REQ_BUCKETS];
+    int n_cpus;
+    int *cpus;
+    int *cpu_nodes;
+    char *fallback; /* Answer when the queue is full, or NULL. */
+    int max_exec_ms;
+    char *exec_fallback; /* Answer when a script runs too long, or NULL. */
+    int arena;
+    int huge_pages;
+    size_t max_heap_bytes;
+    int gc_interval;
+    int gc_when_idle;
+    int recycle_after;
+    size_t recycle_growth;
+    int compile_rules;
+    int my_ip_ttl_ms;
+    void (*mem_stats_cb)(const struct pac_mem_stats *stats, void *arg);
+    void *mem_stats_arg;
+    void (*ready_cb)(void *arg);
+    void *ready_arg;
+    pthread_mutex_t stats_mtx;
+    struct pac_stats stats;
+    /* Protects the fields below, tenants and scripts. */
     pthread_mutex_t ctx_mtx;
-    int n_ctx;
-    duk_context **ctx;
+    /* Signalled when a context is returned, or room is freed up. */
+    pthread_cond_t ctx_cond;
+    struct tenant *tenant; /* The script passed to pac_init_opts(). */
+    struct tenant *tenants[TENANT_BUCKETS]; /* By ID. */
+    int n_ctx;             /* Contexts built up front for pac->tenant. */
+    int max_ctx;           /* Cap on contexts of all scripts. */
+    int n_live;            /* Contexts existing or being built. */
+    struct pac_ctx *idle;  /* Free contexts of all scripts. */
+    struct pac_ctx *spares; /* Replacements for worn out contexts. */
+    struct rebuild_args *rebuilds; /* Replacements being built. */
+    struct pac_ctx *draining; /* To free once no lookups are parked. */
+};
+
+/* A caller waiting for the result of a lookup. */
+struct waiter {
+    struct proxy_args *pa;
+    unsigned long handle;
+    unsigned long long deadline; /* util_now_ms() based, or 0. */
+    int cancelled;
+    void (*cb)(char *, void *);
+    void *arg;
+    struct waiter *next;        /* Next waiter of the same lookup. */
+    struct waiter *next_handle; /* In pac->reqs. */
 };
 
+/*
+ * One evaluation of FindProxyForURL(url, host). Identical submissions made
+ * while it is queued or running attach to it as additional waiters.
+ */
 struct proxy_args {
     struct pac *pac;
+    int lane;
+    struct tenant *tenant;    /* Whose script to run. */
+    unsigned int generation;  /* Of the script when submitted. */
+    unsigned int hash;        /* Of url and host. */
+    int inflight;             /* Linked into pac->inflight. */
+    int aborted;              /* Nobody waits for the result any more. */
+    struct proxy_args *next;  /* In pac->inflight. */
+    struct waiter *waiters, *last_waiter;
     char *url;
     char *host;
-    void (*cb)(char *, void *);
     char *result;
-    void *arg;
+    /* Evaluation state, see run_find_proxy(). */
+    int skip_rules;           /* No compiled rule matches. */
+    int resolved;             /* Called dnsResolve(). */
+    int over_budget;
+    int over_memory;
+    unsigned long allocs;
+    unsigned int co;          /* ID of its coroutine, or 0. */
+    duk_context *co_ctx;      /* The coroutine. */
+    struct pac_ctx *pc;       /* Context it is parked on. */
+    struct dns_query *dns;    /* Query in flight, or NULL. */
+};
+
+/* DNS lookup of a suspendable evaluation, for a resolver thread. */
+struct dns_query {
+    struct pac *pac;
+    struct proxy_args *pa;
+    char *host;
+    int all_results;
+    int running;   /* A resolver thread is on it. */
+    int abandoned; /* The evaluation resolved the host itself. */
+    int done;
+    int parked;    /* The evaluation is parked, waiting for it. */
+    char result[UTIL_BUFLEN];
 };
 
 /*
@@ -88,10 +255,10 @@ static void _pac_log(int level, const char *fmt, ...)
 #define logw(...) do { \
     _pac_log(PAC_LOGLVL_WARN, __VA_ARGS__); \
 } while(0)
-#define logi(fmt, ...) do { \
+#define logi(...) do { \
     _pac_log(PAC_LOGLVL_INFO, __VA_ARGS__); \
 } while(0)
-#define logd(fmt, ...) do { \
+#define logd(...) do { \
     _pac_log(PAC_LOGLVL_DEBUG, __VA_ARGS__); \
 } while(0)
 
@@ -100,6 +267,16 @@ static void fatal_handler(void *udata, const char *msg)
     logw("Fatal error: %s (%p).", msg, udata);
 }
 
+static struct pac_ctx *ctx_of(duk_context *ctx)
+{
+    duk_memory_functions funcs;
+
+    duk_get_memory_functions(ctx, &funcs);
+    return funcs.udata;
+}
+
+static void resolve_host(void *arg);
+
 /*
  * Note: error handling in these function is not standardized. The best
  * documentation available is:
@@ -109,10 +286,69 @@ static void fatal_handler(void *udata, const char *msg)
  * which states that (at least for the *Ex versions) the function should
  * return an empty string if an error occurs (and not throw an error).
  */
-static int _dns_resolve(duk_context *ctx, int all_results)
+
+/*
+ * With resolver threads, dnsResolve() and dnsResolveEx() are Javascript
+ * wrappers around dns_start() and dns_wait(), so that they can yield the
+ * coroutine of the lookup, see step_find_proxy(). Yielding fails if there
+ * is a native call (such as Array.prototype.forEach()) on the way up; the
+ * wrapper then waits for the answer instead. Also sets up the stash for
+ * the coroutines. Without resolver threads, they are plain natives.
+ */
+static const char *pac_dns_wrappers =
+"(function (start, wait, Thread, stash) {\n"
+"    var parked = stash.parked = {};\n"
+"    function resolve(host, all) {\n"
+"        var ip = start(host, all);\n"
+"        if (typeof ip === 'string')\n"
+"            return ip;\n"
+"        try {\n"
+"            return Thread.yield(parked);\n"
+"        } catch (e) {\n"
+"            return wait();\n"
+"        }\n"
+"    }\n"
+"    dnsResolve = function (host) { return resolve(host, false); };\n"
+"    dnsResolveEx = function (host) { return resolve(host, true); };\n"
+"    stash.entry = function (args) {\n"
+"        return FindProxyForURL(args[0], args[1], args[2]);\n"
+"    };\n"
+"    stash.step = function (t, v) { return Thread.resume(t, v); };\n"
+"})";
+
+/*
+ * Start resolving a host. In the coroutine of a lookup, the host is handed
+ * to a resolver thread, and undefined returned for the wrapper to yield.
+ * Otherwise, the answer is returned right away.
+ */
+static int dns_start(duk_context *ctx)
 {
     char buf[UTIL_BUFLEN];
     const char *host = duk_require_string(ctx, 0);
+    int all_results = duk_to_boolean(ctx, 1);
+    struct pac_ctx *pc = ctx_of(ctx);
+    struct proxy_args *pa = pc ? pc->req : NULL;
+    struct dns_query *q;
+
+    /* Remember that this lookup is DNS-bound, see record_lane(). */
+    if (pc)
+        pc->resolved = 1;
+
+    if (pa && pa->co && pa->co_ctx == ctx && !pa->dns) {
+        q = calloc(1, sizeof(struct dns_query));
+        if (q && (q->host = strdup(host))) {
+            q->pac = pa->pac;
+            q->pa = pa;
+            q->all_results = all_results;
+            pa->dns = q;
+            if (threadpool_schedule(pa->pac->resolver_pool, resolve_host,
+                                    q) >= 0)
+                return 0;
+            pa->dns = NULL;
+            free(q->host);
+        }
+        free(q);
+    }
 
     if (util_dns_resolve(host, buf, sizeof(buf), all_results) < 0)
         buf[0] = '\0';
@@ -121,22 +357,141 @@ static int _dns_resolve(duk_context *ctx, int all_results)
     return 1;
 }
 
+/*
+ * Get the answer to the query of pa without parking: wait for the
+ * resolver thread if it is already on it, or else resolve here.
+ */
+static void settle_query(struct proxy_args *pa, char *buf, size_t len)
+{
+    struct dns_query *q = pa->dns;
+    struct pac *pac = pa->pac;
+    char *host = NULL;
+    int all_results = q->all_results;
+
+    pa->dns = NULL;
+
+    pthread_mutex_lock(&pac->dns_mtx);
+    if (!q->running) {
+        /* The resolver thread frees it. */
+        q->abandoned = 1;
+        host = q->host;
+        q->host = NULL;
+    } else {
+        while (!q->done)
+            pthread_cond_wait(&pac->dns_cond, &pac->dns_mtx);
+    }
+    pthread_mutex_unlock(&pac->dns_mtx);
+
+    if (host) {
+        if (util_dns_resolve(host, buf, len, all_results) < 0)
+            buf[0] = '\0';
+        free(host);
+        return;
+    }
+
+    snprintf(buf, len, "%s", q->result);
+    free(q->host);
+    free(q);
+}
+
+/* The wrapper of dnsResolve() could not yield: get the answer here. */
+static int dns_wait(duk_context *ctx)
+{
+    char buf[UTIL_BUFLEN];
+    struct pac_ctx *pc = ctx_of(ctx);
+    struct proxy_args *pa = pc ? pc->req : NULL;
+
+    buf[0] = '\0';
+    if (pa && pa->dns)
+        settle_query(pa, buf, sizeof(buf));
+
+    duk_push_string(ctx, buf);
+    return 1;
+}
+
+/* Without resolver threads: answer right away, as dns_start() does. */
 static int dns_resolve(duk_context *ctx)
 {
-    return _dns_resolve(ctx, RETURN_SINGLE_RESULT);
+    duk_push_false(ctx);
+    return dns_start(ctx);
 }
 
 static int dns_resolve_ex(duk_context *ctx)
 {
-    return _dns_resolve(ctx, RETURN_ALL_RESULTS);
+    duk_push_true(ctx);
+    return dns_start(ctx);
+}
+
+/*
+ * The network state lookups depend on: the addresses of this host, for
+ * contexts with a my_ip_ttl_ms.
+ */
+static struct {
+    pthread_mutex_t mtx;
+    char ip[2][UTIL_BUFLEN];     /* By all_results. */
+    int valid[2];
+    unsigned long long fetched[2]; /* util_now_ms() based. */
+    unsigned int changes; /* Bumped by pac_network_changed(). */
+} net = {.mtx = PTHREAD_MUTEX_INITIALIZER};
+
+/*
+ * The addresses of this host, as myIpAddress() returns them, reused for
+ * up to ttl_ms. The system is asked without holding net.mtx, so that a
+ * slow answer only holds up the lookups that need it.
+ */
+static void my_ip(char *buf, size_t len, int all_results, int ttl_ms)
+{
+    char ip[UTIL_BUFLEN];
+    unsigned long long now;
+    unsigned int changes;
+
+    if (ttl_ms <= 0) {
+        if (util_my_ip_address(buf, len, all_results) < 0)
+            buf[0] = '\0';
+        return;
+    }
+
+    now = util_now_ms();
+    pthread_mutex_lock(&net.mtx);
+    if (net.valid[all_results] &&
+        now - net.fetched[all_results] < (unsigned long long)ttl_ms) {
+        snprintf(buf, len, "%s", net.ip[all_results]);
+        pthread_mutex_unlock(&net.mtx);
+        return;
+    }
+    changes = net.changes;
+    pthread_mutex_unlock(&net.mtx);
+
+    if (util_my_ip_address(ip, sizeof(ip), all_results) < 0)
+        ip[0] = '\0';
+    snprintf(buf, len, "%s", ip);
+
+    /* Unless the network changed meanwhile, or a newer answer is in. */
+    pthread_mutex_lock(&net.mtx);
+    if (changes == net.changes &&
+        (!net.valid[all_results] || net.fetched[all_results] <= now)) {
+        snprintf(net.ip[all_results], sizeof(net.ip[all_results]), "%s", ip);
+        net.valid[all_results] = 1;
+        net.fetched[all_results] = now;
+    }
+    pthread_mutex_unlock(&net.mtx);
+}
+
+void pac_network_changed(void)
+{
+    pthread_mutex_lock(&net.mtx);
+    net.valid[RETURN_SINGLE_RESULT] = 0;
+    net.valid[RETURN_ALL_RESULTS] = 0;
+    net.changes++;
+    pthread_mutex_unlock(&net.mtx);
 }
 
 static int _my_ip_address(duk_context *ctx, int all_results)
 {
+    struct pac_ctx *pc = ctx_of(ctx);
     char buf[UTIL_BUFLEN];
 
-    if (util_my_ip_address(buf, sizeof(buf), all_results) < 0)
-        buf[0] = '\0';
+    my_ip(buf, sizeof(buf), all_results, pc ? pc->my_ip_ttl_ms : 0);
 
     duk_push_string(ctx, buf);
     return 1;
@@ -152,273 +507,2496 @@ static int my_ip_address_ex(duk_context *ctx)
     return _my_ip_address(ctx, RETURN_ALL_RESULTS);
 }
 
-static void *alloc_ctx(char *js)
+/*
+ * Helpers built from a list of strings, like dnsDomainSet(), return an
+ * object holding a native matcher, whose match() method gives the index
+ * of the first string matching its argument, or -1.
+ */
+static void *matcher_of(duk_context *ctx, duk_idx_t idx)
 {
-    duk_context *ctx;
-
-    ctx = duk_create_heap(NULL, NULL, NULL, NULL, fatal_handler);
-    if (!ctx)
-        return ctx;
+    void *m;
 
-    duk_push_global_object(ctx);
-    duk_push_c_function(ctx, dns_resolve, 1 /*nargs*/);
-    duk_put_prop_string(ctx, -2, "dnsResolve");
-    duk_push_c_function(ctx, my_ip_address, 0 /*nargs*/);
-    duk_put_prop_string(ctx, -2, "myIpAddress");
-    duk_push_c_function(ctx, dns_resolve_ex, 1 /*nargs*/);
-    duk_put_prop_string(ctx, -2, "dnsResolveEx");
-    duk_push_c_function(ctx, my_ip_address_ex, 0 /*nargs*/);
-    duk_put_prop_string(ctx, -2, "myIpAddressEx");
+    duk_get_prop_string(ctx, idx, DUK_HIDDEN_SYMBOL("matcher"));
+    m = duk_get_pointer(ctx, -1);
     duk_pop(ctx);
 
-    duk_eval_string(ctx, nsProxyAutoConfig);
-    duk_pop(ctx);
+    return m;
+}
 
-    duk_eval_string(ctx, nsProxyAutoConfig0);
-    duk_pop(ctx);
+/* For finalizers: the matcher, which the object no longer holds. */
+static void *take_matcher(duk_context *ctx)
+{
+    void *m = matcher_of(ctx, 0);
 
-    /* Try to evaluate our Javascript PAC file. */
-    if (duk_peval_string(ctx, js) != 0) {
-        logw("Failed to evaluate PAC file: %s.", duk_safe_to_string(ctx, -1));
-        duk_pop(ctx);
-        duk_destroy_heap(ctx);
-        errno = EINVAL;
-        return NULL;
-    }
-    duk_pop(ctx);
+    duk_push_pointer(ctx, NULL);
+    duk_put_prop_string(ctx, 0, DUK_HIDDEN_SYMBOL("matcher"));
 
-    return ctx;
+    return m;
 }
 
-static char *find_proxy(duk_context *ctx, char *url, char *host)
+static void push_matcher(duk_context *ctx, void *m, duk_c_function finalize,
+                         duk_c_function match)
 {
-    char *result = NULL;
-    const char *proxy;
+    duk_push_object(ctx);
+    duk_push_pointer(ctx, m);
+    duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("matcher"));
+    duk_push_c_function(ctx, finalize, 1 /*nargs*/);
+    duk_set_finalizer(ctx, -2);
+    duk_push_c_function(ctx, match, 1 /*nargs*/);
+    duk_put_prop_string(ctx, -2, "match");
+}
 
-    duk_push_global_object(ctx);
-    duk_get_prop_string(ctx, -1 /*index*/, "FindProxyForURL");
-    duk_push_string(ctx, url);
-    duk_push_string(ctx, host);
+/*
+ * dnsDomainSet(domains): match(host) finds the first of the domains that
+ * dnsDomainIs(host, domain), in one walk over the labels of host.
+ */
+static int domain_set_finalize(duk_context *ctx)
+{
+    suffix_trie_free(take_matcher(ctx));
+    return 0;
+}
 
-    if (duk_pcall(ctx, 2 /*nargs*/) == DUK_EXEC_SUCCESS) {
-        proxy = duk_to_string(ctx, -1);
-        if (!proxy)
-            logw("Failed to allocate proxy string.");
-        else
-            result = strdup(proxy);
-    } else {
-        if (duk_is_error(ctx, -1)) {
-            /*
-             * Accessing .stack might cause an error to be thrown, so
-             * wrap this access in a duk_safe_call() if it matters.
-             */
-            duk_get_prop_string(ctx, -1, "stack");
-            logw("Javascript call failed: %s.", duk_safe_to_string(ctx, -1));
-            duk_pop(ctx); /* Result string. */
-        } else {
-            /* Non-Error value, coerce safely to string. */
-            logw("Javascript call failed: %s.", duk_safe_to_string(ctx, -1));
-        }
-    }
+static int domain_set_match(duk_context *ctx)
+{
+    struct suffix_trie *trie;
+    duk_size_t len;
+    const char *host = duk_to_lstring(ctx, 0, &len);
 
-    duk_pop(ctx); /* Result string. */
-    duk_pop(ctx); /* Global object. */
+    duk_push_this(ctx);
+    trie = matcher_of(ctx, -1);
+    duk_push_int(ctx, trie ? suffix_trie_match(trie, host, len) : -1);
 
-    return result;
+    return 1;
 }
 
-static void main_result(void *arg)
+static int domain_set(duk_context *ctx)
 {
-    struct proxy_args *pa = arg;
-
-    if (pa->host != NULL) {
-        logw("Assertion error: pa->host == %p", pa->host);
-    }
-    if (pa->url != NULL) {
-        logw("Assertion error: pa->url == %p", pa->url);
+    struct suffix_trie *trie = suffix_trie_create();
+    duk_uarridx_t i, n;
+    const char *domain;
+    duk_size_t len;
+
+    if (!trie)
+        return DUK_RET_ERROR;
+    push_matcher(ctx, trie, domain_set_finalize, domain_set_match);
+
+    n = duk_get_length(ctx, 0);
+    for (i = 0; i < n; i++) {
+        duk_get_prop_index(ctx, 0, i);
+        domain = duk_to_lstring(ctx, -1, &len);
+        if (suffix_trie_add(trie, domain, len, i) < 0)
+            return DUK_RET_ERROR;
+        duk_pop(ctx);
     }
 
-    pa->cb(pa->result, pa->arg);
-
-    free(pa);
+    return 1;
 }
 
-static duk_context *pop_context(struct pac *pac)
+/*
+ * substringSet(terms, ignoreCase): match(s) finds the first of the terms
+ * that s.indexOf(term) != -1, in one pass over s. With ignoreCase, ASCII
+ * letters match regardless of case, like lowercasing both would.
+ */
+static int substring_set_finalize(duk_context *ctx)
 {
-    int i;
-
-    pthread_mutex_lock(&pac->ctx_mtx);
+    aho_free(take_matcher(ctx));
+    return 0;
+}
 
-    for (i = 0; i < pac->n_ctx; i++) {
-        if (pac->ctx[i] != NULL) {
-            duk_context *ctx = pac->ctx[i];
-            pac->ctx[i] = NULL;
-            pthread_mutex_unlock(&pac->ctx_mtx);
-            return ctx;
-        }
-    }
+static int substring_set_match(duk_context *ctx)
+{
+    struct aho *aho;
+    duk_size_t len;
+    const char *s = duk_to_lstring(ctx, 0, &len);
 
-    pthread_mutex_unlock(&pac->ctx_mtx);
+    duk_push_this(ctx);
+    aho = matcher_of(ctx, -1);
+    duk_push_int(ctx, aho ? aho_match(aho, s, len) : -1);
 
-    assert(0);
+    return 1;
 }
 
-static void push_context(struct pac *pac, duk_context *ctx)
+static int substring_set(duk_context *ctx)
 {
-    int i;
-
-    pthread_mutex_lock(&pac->ctx_mtx);
-
-    for (i = 0; i < pac->n_ctx; i++) {
-        if (pac->ctx[i] == NULL) {
-            pac->ctx[i] = ctx;
-            pthread_mutex_unlock(&pac->ctx_mtx);
-            return;
-        }
+    struct aho *aho = aho_create(duk_to_boolean(ctx, 1));
+    duk_uarridx_t i, n;
+    const char *term;
+    duk_size_t len;
+
+    if (!aho)
+        return DUK_RET_ERROR;
+    push_matcher(ctx, aho, substring_set_finalize, substring_set_match);
+
+    n = duk_get_length(ctx, 0);
+    for (i = 0; i < n; i++) {
+        duk_get_prop_index(ctx, 0, i);
+        term = duk_to_lstring(ctx, -1, &len);
+        if (aho_add(aho, term, len, i) < 0)
+            return DUK_RET_ERROR;
+        duk_pop(ctx);
     }
+    if (aho_build(aho) < 0)
+        return DUK_RET_ERROR;
 
-    pthread_mutex_unlock(&pac->ctx_mtx);
-
-    assert(0);
+    return 1;
 }
 
-static void _pac_find_proxy(void *arg)
+/*
+ * ipRangeSet(ranges): match(ip) finds the first of the ranges, like
+ * "10.0.0.0/8" or "2001:db8::/32", containing the IP address ip, in one
+ * walk down a tree of networks. Host names aren't resolved: see
+ * dnsResolve().
+ */
+static int ip_range_set_finalize(duk_context *ctx)
 {
-    struct proxy_args *pa = arg;
-    struct pac *pac = pa->pac;
-    duk_context *ctx = pop_context(pac);
-
-    pa->result = find_proxy(ctx, pa->url, pa->host);
+    radix_free(take_matcher(ctx));
+    return 0;
+}
 
-    free(pa->host);
-    pa->host = NULL;
-    free(pa->url);
-    pa->url = NULL;
+static int ip_range_set_match(duk_context *ctx)
+{
+    unsigned char addr[16];
+    struct radix *radix;
+    duk_size_t len;
+    const char *ip = duk_to_lstring(ctx, 0, &len);
 
-    push_context(pac, ctx);
+    duk_push_this(ctx);
+    radix = matcher_of(ctx, -1);
+    duk_push_int(ctx, radix && radix_parse(ip, len, addr) > 0
+                          ? radix_match(radix, addr)
+                          : -1);
 
-    threadpool_schedule_back(pac->threadpool, main_result, pa);
+    return 1;
 }
 
-int pac_find_proxy(struct pac *pac, char *url, char *host,
-                   void (*cb)(char *_result, void *_arg), void *arg)
+/* "addr/bits", or just "addr" for a single address. */
+static int parse_range(const char *range, duk_size_t len,
+                       unsigned char addr[16])
 {
-    struct proxy_args *pa = malloc(sizeof(struct proxy_args));
+    const char *slash = memchr(range, '/', len);
+    int family, bits = -1;
+    char *end = NULL;
 
-    if (!pa) {
-        logw("Failed to allocate proxy arguments.");
+    family = radix_parse(range, slash ? (size_t)(slash - range) : len, addr);
+    if (family < 0)
         return -1;
-    }
-
-    pa->pac = pac;
-    pa->url = strdup(url);
-    pa->host = strdup(host);
-    pa->arg = arg;
-    pa->cb = cb;
-    pa->result = NULL;
+    if (!slash)
+        return 128;
 
-    if (!pa->url || !pa->host) {
-        logw("Failed to allocate proxy arguments.");
+    if (slash + 1 < range + len && isdigit((unsigned char)slash[1]))
+        bits = strtol(slash + 1, &end, 10);
+    if (bits < 0 || end != range + len || bits > (family == 4 ? 32 : 128))
         return -1;
-    }
 
-    if (threadpool_schedule(pac->threadpool, _pac_find_proxy, pa) < 0) {
-        logw("Failed to schedule work item.");
-        return -1;
+    return family == 4 ? 96 + bits : bits;
+}
+
+static int ip_range_set(duk_context *ctx)
+{
+    struct radix *radix = radix_create();
+    unsigned char addr[16];
+    duk_uarridx_t i, n;
+    const char *range;
+    duk_size_t len;
+    int bits;
+
+    if (!radix)
+        return DUK_RET_ERROR;
+    push_matcher(ctx, radix, ip_range_set_finalize, ip_range_set_match);
+
+    n = duk_get_length(ctx, 0);
+    for (i = 0; i < n; i++) {
+        duk_get_prop_index(ctx, 0, i);
+        range = duk_to_lstring(ctx, -1, &len);
+        bits = parse_range(range, len, addr);
+        if (bits < 0)
+            return duk_error(ctx, DUK_ERR_RANGE_ERROR,
+                             "invalid IP range: %s", range);
+        if (radix_add(radix, addr, bits, i) < 0)
+            return DUK_RET_ERROR;
+        duk_pop(ctx);
     }
 
-    return 0;
+    return 1;
 }
 
-int pac_find_proxy_sync(char *js, char *url, char *host, char **proxy)
+/* A JS heap with our native functions and the PAC helpers, but no PAC. */
+static void *ctx_alloc(void *udata, duk_size_t size)
 {
-    duk_context *ctx = alloc_ctx(js);
-    if (ctx) {
-        *proxy = find_proxy(ctx, url, host);
-        duk_destroy_heap(ctx);
-        return 0;
-    } else {
-        logw("Failed to allocate JS context.");
-        return -1;
-    }
+    return arena_alloc(((struct pac_ctx *)udata)->arena, size);
 }
 
-void pac_run_callbacks(struct pac *pac)
+static void *ctx_realloc(void *udata, void *ptr, duk_size_t size)
 {
-    threadpool_run_callbacks(pac->threadpool);
+    return arena_realloc(((struct pac_ctx *)udata)->arena, ptr, size);
 }
 
-static int check_js(char *js)
+static void ctx_free(void *udata, void *ptr)
 {
-    duk_context *ctx = alloc_ctx(js);
-    if (!ctx)
-        return -1;
+    arena_free(((struct pac_ctx *)udata)->arena, ptr);
+}
 
-    duk_destroy_heap(ctx);
+/*
+ * The Javascript helper library, compiled to bytecode once per process:
+ * every heap loads it from there instead of parsing the source again.
+ */
+#define N_HELPERS 3
 
-    return 0;
+static struct {
+    pthread_once_t once;
+    void *bytecode[N_HELPERS];
+    size_t len[N_HELPERS];
+} helper_lib = {PTHREAD_ONCE_INIT};
+
+static const char *helper_source(int i)
+{
+    switch (i) {
+    case 0:
+        return pac_dns_wrappers;
+    case 1:
+        return nsProxyAutoConfig;
+    default:
+        return nsProxyAutoConfig0;
+    }
 }
 
-struct pac *pac_init(char *js, int n_threads, void (*notify_cb)(void *),
-                     void *arg)
+static void compile_helpers(void)
 {
-    struct pac *pac = NULL;
-    int i, ret = check_js(js);
-    if (ret)
-        goto err;
+    duk_context *ctx = duk_create_heap(NULL, NULL, NULL, NULL,
+                                       fatal_handler);
+    duk_size_t len;
+    void *bytecode;
+    int i;
 
-    ret = -1;
+    if (!ctx)
+        return;
 
-    pac = calloc(1, sizeof(struct pac));
-    if (!pac) {
-        logw("Error allocating PAC.");
-        goto err;
+    for (i = 0; i < N_HELPERS; i++) {
+        if (duk_pcompile_string(ctx, DUK_COMPILE_EVAL,
+                                helper_source(i)) != 0) {
+            logw("Failed to compile helpers: %s.",
+                 duk_safe_to_string(ctx, -1));
+            break;
+        }
+        duk_dump_function(ctx);
+        bytecode = duk_get_buffer_data(ctx, -1, &len);
+        helper_lib.bytecode[i] = malloc(len);
+        if (!helper_lib.bytecode[i])
+            break;
+        memcpy(helper_lib.bytecode[i], bytecode, len);
+        helper_lib.len[i] = len;
+        duk_pop(ctx);
     }
+    duk_destroy_heap(ctx);
+}
 
-    pac->javascript = strdup(js);
-    pac->n_ctx = n_threads; /* One context per worker thread. */
-    pac->ctx = calloc(pac->n_ctx, sizeof(duk_context *));
-    pac->threadpool = threadpool_create(n_threads, notify_cb, arg);
-    if (!pac->javascript || !pac->ctx || !pac->threadpool) {
-        logw("Error setting up PAC.");
+/*
+ * Evaluate part i of the helper library as duk_eval_string() would, and
+ * leave its value on the stack. From the source if it failed to compile.
+ */
+static void eval_helper(duk_context *ctx, int i)
+{
+    if (!helper_lib.bytecode[i]) {
+        duk_eval_string(ctx, helper_source(i));
+        return;
+    }
+
+    duk_push_external_buffer(ctx);
+    duk_config_buffer(ctx, -1, helper_lib.bytecode[i], helper_lib.len[i]);
+    duk_load_function(ctx);
+    duk_push_global_object(ctx);
+    duk_call_method(ctx, 0);
+}
+
+static duk_context *new_heap(struct pac_ctx *pc)
+{
+    duk_context *ctx;
+
+    pthread_once(&helper_lib.once, compile_helpers);
+
+    if (pc && pc->arena)
+        ctx = duk_create_heap(ctx_alloc, ctx_realloc, ctx_free, pc,
+                              fatal_handler);
+    else
+        ctx = duk_create_heap(NULL, NULL, NULL, pc, fatal_handler);
+    if (!ctx)
+        return ctx;
+
+    duk_push_global_object(ctx);
+    duk_push_c_function(ctx, my_ip_address, 0 /*nargs*/);
+    duk_put_prop_string(ctx, -2, "myIpAddress");
+    duk_push_c_function(ctx, my_ip_address_ex, 0 /*nargs*/);
+    duk_put_prop_string(ctx, -2, "myIpAddressEx");
+    duk_push_c_function(ctx, domain_set, 1 /*nargs*/);
+    duk_put_prop_string(ctx, -2, "dnsDomainSet");
+    duk_push_c_function(ctx, substring_set, 2 /*nargs*/);
+    duk_put_prop_string(ctx, -2, "substringSet");
+    duk_push_c_function(ctx, ip_range_set, 1 /*nargs*/);
+    duk_put_prop_string(ctx, -2, "ipRangeSet");
+    if (!pc || !pc->coroutines) {
+        duk_push_c_function(ctx, dns_resolve, 1 /*nargs*/);
+        duk_put_prop_string(ctx, -2, "dnsResolve");
+        duk_push_c_function(ctx, dns_resolve_ex, 1 /*nargs*/);
+        duk_put_prop_string(ctx, -2, "dnsResolveEx");
+    }
+    duk_pop(ctx);
+
+    if (pc && pc->coroutines) {
+        eval_helper(ctx, 0);
+        duk_push_c_function(ctx, dns_start, 2 /*nargs*/);
+        duk_push_c_function(ctx, dns_wait, 0 /*nargs*/);
+        duk_eval_string(ctx, "Duktape.Thread");
+        duk_push_global_stash(ctx);
+        duk_call(ctx, 4 /*nargs*/);
+        duk_pop(ctx);
+    }
+
+    eval_helper(ctx, 1);
+    duk_pop(ctx);
+
+    eval_helper(ctx, 2);
+    duk_pop(ctx);
+
+    /* Loading leaves cycles behind (functions and their prototypes). */
+    duk_gc(ctx, 0);
+
+    return ctx;
+}
+
+static void *alloc_ctx(char *js)
+{
+    duk_context *ctx = new_heap(NULL);
+    if (!ctx)
+        return ctx;
+
+    /* Try to evaluate our Javascript PAC file. */
+    if (duk_peval_string(ctx, js) != 0) {
+        logw("Failed to evaluate PAC file: %s.", duk_safe_to_string(ctx, -1));
+        duk_pop(ctx);
+        duk_destroy_heap(ctx);
+        errno = EINVAL;
+        return NULL;
+    }
+    duk_pop(ctx);
+
+    return ctx;
+}
+
+static void free_script(struct pac_script *script)
+{
+    if (!script->rom) {
+        free(script->javascript);
+        free(script->bytecode);
+    }
+    rules_free(script->rules);
+    free(script);
+}
+
+/*
+ * Compile js to bytecode, after checking that it evaluates without errors.
+ * The returned script holds one reference.
+ */
+static struct pac_script *compile_js(char *js, int quiet)
+{
+    struct pac_script *script = NULL;
+    duk_context *ctx = new_heap(NULL);
+    duk_size_t len;
+    void *bytecode;
+
+    if (!ctx) {
+        logw("Failed to allocate JS context.");
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (duk_pcompile_string(ctx, 0, js) != 0)
+        goto err;
+
+    duk_dup(ctx, -1);
+    duk_dump_function(ctx);
+    duk_swap_top(ctx, -2);
+    if (duk_pcall(ctx, 0) != 0)
+        goto err;
+    duk_pop(ctx);
+
+    bytecode = duk_get_buffer_data(ctx, -1, &len);
+
+    script = calloc(1, sizeof(struct pac_script));
+    if (script) {
+        script->refs = 1;
+        script->javascript = strdup(js);
+        script->bytecode = malloc(len);
+        script->bytecode_len = len;
+    }
+    if (!script || !script->javascript || !script->bytecode) {
+        logw("Failed to allocate PAC script.");
+        if (script)
+            free_script(script);
+        duk_destroy_heap(ctx);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(script->bytecode, bytecode, len);
+
+    duk_destroy_heap(ctx);
+    return script;
+
+err:
+    if (!quiet)
+        logw("Failed to evaluate PAC file: %s.",
+             duk_safe_to_string(ctx, -1));
+    duk_destroy_heap(ctx);
+    errno = EINVAL;
+    return NULL;
+}
+
+/*
+ * Compile a PAC script. With compile_rules, its leading rules are compiled
+ * too, and the bytecode is that of the rewritten script, see
+ * rules_compile().
+ */
+static struct pac_script *compile_script(char *js, int compile_rules)
+{
+    struct pac_script *script = NULL;
+    struct rules *rules = NULL;
+    char *rewritten;
+
+    if (compile_rules)
+        rules = rules_compile(js, &rewritten);
+    if (rules) {
+        script = compile_js(rewritten, 1);
+        free(rewritten);
+        if (script) {
+            script->rules = rules;
+            return script;
+        }
+        logw("Failed to compile the rules of the PAC file, running it as is.");
+        rules_free(rules);
+    }
+
+    return compile_js(js, 0);
+}
+
+int pac_compile_rom(char *js, int compile_rules, unsigned char **bytecode,
+                    size_t *len)
+{
+    struct pac_script *script = compile_script(js, compile_rules);
+    int ret = 0;
+
+    if (!script)
+        return -1;
+
+    if (compile_rules && !script->rules) {
+        ret = 1;
+    } else {
+        *bytecode = malloc(script->bytecode_len);
+        *len = script->bytecode_len;
+        if (*bytecode)
+            memcpy(*bytecode, script->bytecode, *len);
+        else
+            ret = -1;
+    }
+    free_script(script);
+
+    return ret;
+}
+
+/* The script built into the library, see rom.h. */
+static struct pac_script *rom_script(int compile_rules)
+{
+#ifdef PAC_ROM_PAC
+    struct pac_script *script = calloc(1, sizeof(struct pac_script));
+    char *rewritten;
+
+    if (!script) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    script->refs = 1;
+    script->rom = 1;
+    script->javascript = (char *)pac_rom.javascript;
+    script->bytecode = (void *)pac_rom.bytecode;
+    script->bytecode_len = pac_rom.bytecode_len;
+
+    /* The same rules as at build time, for which there is bytecode. */
+    if (compile_rules && pac_rom.rules_bytecode) {
+        script->rules = rules_compile(pac_rom.javascript, &rewritten);
+        free(rewritten);
+        if (script->rules) {
+            script->bytecode = (void *)pac_rom.rules_bytecode;
+            script->bytecode_len = pac_rom.rules_bytecode_len;
+        }
+    }
+
+    return script;
+#else
+    (void)compile_rules;
+    logw("No PAC script built in, see configure --with-rom-pac.");
+    errno = ENOENT;
+    return NULL;
+#endif
+}
+
+static int load_script(duk_context *ctx, struct pac_script *script)
+{
+    /* Loading copies what it needs out of the bytecode. */
+    duk_push_external_buffer(ctx);
+    duk_config_buffer(ctx, -1, script->bytecode, script->bytecode_len);
+    duk_load_function(ctx);
+    if (duk_pcall(ctx, 0) != 0) {
+        logw("Failed to evaluate PAC file: %s.", duk_safe_to_string(ctx, -1));
+        duk_pop(ctx);
+        return -1;
+    }
+    duk_pop(ctx);
+
+    return 0;
+}
+
+static void script_ref(struct pac *pac, struct pac_script *script)
+{
+    pthread_mutex_lock(&pac->ctx_mtx);
+    script->refs++;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+}
+
+static void script_unref(struct pac *pac, struct pac_script *script)
+{
+    int refs;
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    refs = --script->refs;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (refs == 0)
+        free_script(script);
+}
+
+static void tenant_unref(struct pac *pac, struct tenant *t)
+{
+    int refs;
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    refs = --t->refs;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (refs == 0) {
+        free(t->id);
+        free(t);
+    }
+}
+
+static struct pac_ctx *new_ctx(struct pac *pac, struct pac_script *script,
+                               int node)
+{
+    struct pac_ctx *pc = calloc(1, sizeof(struct pac_ctx));
+    if (!pc)
+        return NULL;
+
+    pc->node = node;
+    pc->slot = -1;
+    pc->my_ip_ttl_ms = pac->my_ip_ttl_ms;
+    pc->coroutines = pac->resolver_pool != NULL;
+    if (pac->arena) {
+        pc->arena = arena_create(pac->huge_pages);
+        if (!pc->arena) {
+            free(pc);
+            return NULL;
+        }
+        arena_set_limit(pc->arena, pac->max_heap_bytes);
+    }
+    pc->ctx = new_heap(pc);
+    if (!pc->ctx || load_script(pc->ctx, script) < 0) {
+        if (pc->ctx)
+            duk_destroy_heap(pc->ctx);
+        if (pc->arena)
+            arena_destroy(pc->arena);
+        free(pc);
+        return NULL;
+    }
+
+    pc->script = script;
+    script_ref(pac, script);
+
+    if (pc->arena) {
+        struct arena_stats stats;
+        arena_get_stats(pc->arena, &stats);
+        pc->base_bytes = stats.bytes_live;
+    }
+
+    return pc;
+}
+
+static void forget_origin(struct pac *pac, struct pac_ctx *pc);
+
+static void free_ctx(struct pac *pac, struct pac_ctx *pc)
+{
+    struct pac_script *script = pc->script;
+    int refs;
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    forget_origin(pac, pc);
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    duk_destroy_heap(pc->ctx);
+    if (pc->arena)
+        arena_destroy(pc->arena);
+    free(pc);
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    pac->n_live--;
+    refs = --script->refs;
+    pthread_cond_signal(&pac->ctx_cond);
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (refs == 0)
+        free_script(script);
+}
+
+static void free_ctx_list(struct pac *pac, struct pac_ctx *pc)
+{
+    struct pac_ctx *next;
+
+    for (; pc; pc = next) {
+        next = pc->next;
+        free_ctx(pac, pc);
+    }
+}
+
+struct build_args {
+    struct pac *pac;
+    struct pac_script *script;
+    int node;
+    struct pac_ctx *pc;
+};
+
+static void build_ctx(void *arg)
+{
+    struct build_args *ba = arg;
+
+    ba->pc = new_ctx(ba->pac, ba->script, ba->node);
+}
+
+/*
+ * Create context #i. If workers are pinned, the context is assigned a CPU
+ * round-robin, and built while running on that CPU, so the heap pages are
+ * first touched on (and thus allocated from) that CPU's NUMA node.
+ */
+static struct pac_ctx *build_ctx_for_slot(struct pac *pac,
+                                          struct pac_script *script, int i)
+{
+    struct build_args ba = { pac, script, -1, NULL };
+
+    if (pac->n_cpus == 0) {
+        build_ctx(&ba);
+        return ba.pc;
+    }
+
+    ba.node = pac->cpu_nodes[i % pac->n_cpus];
+    if (util_run_on_cpu(pac->cpus[i % pac->n_cpus], build_ctx, &ba) < 0)
+        logd("Failed to pin context #%d to CPU %d.", i,
+             pac->cpus[i % pac->n_cpus]);
+    if (ba.pc)
+        ba.pc->slot = i;
+
+    return ba.pc;
+}
+
+/* NUMA node of the CPU the calling worker is pinned to, or -1. */
+static int current_node(struct pac *pac)
+{
+    int i, cpu;
+
+    if (pac->n_cpus == 0)
+        return -1;
+
+    cpu = util_current_cpu();
+    for (i = 0; i < pac->n_cpus; i++)
+        if (pac->cpus[i] == cpu)
+            return pac->cpu_nodes[i];
+
+    return -1;
+}
+
+/* Take the result of a protected call of FindProxyForURL(). */
+static char *call_result(duk_context *ctx, int rc)
+{
+    char *result = NULL;
+    const char *proxy;
+
+    if (rc == DUK_EXEC_SUCCESS) {
+        proxy = duk_to_string(ctx, -1);
+        if (!proxy)
+            logw("Failed to allocate proxy string.");
+        else
+            result = strdup(proxy);
+    } else {
+        if (duk_is_error(ctx, -1)) {
+            /*
+             * Accessing .stack might cause an error to be thrown, so
+             * wrap this access in a duk_safe_call() if it matters.
+             */
+            duk_get_prop_string(ctx, -1, "stack");
+            logw("Javascript call failed: %s.", duk_safe_to_string(ctx, -1));
+            duk_pop(ctx); /* Result string. */
+        } else {
+            /* Non-Error value, coerce safely to string. */
+            logw("Javascript call failed: %s.", duk_safe_to_string(ctx, -1));
+        }
+    }
+
+    duk_pop(ctx); /* Result string. */
+
+    return result;
+}
+
+/* With skip_rules, the compiled rules of the script are skipped. */
+static char *find_proxy(duk_context *ctx, char *url, char *host,
+                        int skip_rules)
+{
+    char *result;
+    int rc;
+
+    duk_push_global_object(ctx);
+    duk_get_prop_string(ctx, -1 /*index*/, "FindProxyForURL");
+    duk_push_string(ctx, url);
+    duk_push_string(ctx, host);
+    if (skip_rules)
+        duk_push_true(ctx);
+
+    rc = duk_pcall(ctx, skip_rules ? 3 : 2 /*nargs*/);
+    result = call_result(ctx, rc);
+
+    duk_pop(ctx); /* Global object. */
+
+    return result;
+}
+
+/*
+ * Run the lookup pa in its own coroutine in pc: start it, or resume it
+ * with the answer to its DNS query. Returns once it is done, or parked on
+ * another query, setting *parked. The coroutines are kept in the global
+ * stash by ID while parked.
+ */
+static char *step_find_proxy(struct pac_ctx *pc, struct proxy_args *pa,
+                             int *parked)
+{
+    duk_context *ctx = pc->ctx;
+    char buf[UTIL_BUFLEN];
+    char *result = NULL;
+    int rc;
+
+    *parked = 0;
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "step");
+    if (!pa->co) {
+        if (!++pc->next_co)
+            pc->next_co = 1;
+        pa->co = pc->next_co;
+        duk_push_thread(ctx);
+        pa->co_ctx = duk_get_context(ctx, -1);
+        duk_get_prop_string(ctx, -3, "entry");
+        duk_xmove_top(pa->co_ctx, ctx, 1);
+        duk_dup_top(ctx);
+        duk_put_prop_index(ctx, -4, pa->co);
+        duk_push_array(ctx);
+        duk_push_string(ctx, pa->url);
+        duk_put_prop_index(ctx, -2, 0);
+        duk_push_string(ctx, pa->host);
+        duk_put_prop_index(ctx, -2, 1);
+        if (pa->skip_rules) {
+            duk_push_true(ctx);
+            duk_put_prop_index(ctx, -2, 2);
+        }
+    } else {
+        duk_get_prop_index(ctx, -2, pa->co);
+        settle_query(pa, buf, sizeof(buf));
+        duk_push_string(ctx, buf);
+    }
+
+    rc = duk_pcall(ctx, 2 /*nargs*/);
+    if (rc == DUK_EXEC_SUCCESS && pa->dns) {
+        duk_get_prop_string(ctx, -2, "parked");
+        *parked = duk_strict_equals(ctx, -1, -2);
+        duk_pop(ctx);
+    }
+    if (*parked) {
+        duk_pop(ctx);
+    } else {
+        result = call_result(ctx, rc);
+        /* Interrupted between starting a query and yielding. */
+        if (pa->dns)
+            settle_query(pa, buf, sizeof(buf));
+        duk_del_prop_index(ctx, -1, pa->co);
+        pa->co_ctx = NULL;
+    }
+
+    duk_pop(ctx); /* Global stash. */
+
+    return result;
+}
+
+#define FNV_OFFSET 2166136261u
+
+static unsigned int hash_str(unsigned int h, const char *str)
+{
+    for (; *str; str++)
+        h = (h ^ (unsigned char)*str) * 16777619u; /* FNV-1a */
+
+    return h;
+}
+
+static unsigned int hash_lookup(const char *url, const char *host)
+{
+    return hash_str(hash_str(FNV_OFFSET, url) * 16777619u, host);
+}
+
+/* The functions below up to main_result() need req_mtx held. */
+
+static void link_inflight(struct pac *pac, struct proxy_args *pa)
+{
+    struct proxy_args **bucket = &pac->inflight[pa->hash & (REQ_BUCKETS - 1)];
+
+    pa->next = *bucket;
+    *bucket = pa;
+    pa->inflight = 1;
+}
+
+static void unlink_inflight(struct pac *pac, struct proxy_args *pa)
+{
+    struct proxy_args **p;
+
+    if (!pa->inflight)
+        return;
+
+    for (p = &pac->inflight[pa->hash & (REQ_BUCKETS - 1)]; *p;
+         p = &(*p)->next) {
+        if (*p == pa) {
+            *p = pa->next;
+            break;
+        }
+    }
+    pa->inflight = 0;
+}
+
+static struct proxy_args *find_inflight(struct pac *pac, struct tenant *t,
+                                        unsigned int hash, const char *url,
+                                        const char *host)
+{
+    struct proxy_args *pa;
+
+    /* Lookups from before a reload don't count. */
+    for (pa = pac->inflight[hash & (REQ_BUCKETS - 1)]; pa; pa = pa->next)
+        if (pa->hash == hash && pa->tenant == t &&
+            pa->generation == pac->generation &&
+            !strcmp(pa->host, host) && !strcmp(pa->url, url))
+            return pa;
+
+    return NULL;
+}
+
+static void add_waiter(struct pac *pac, struct proxy_args *pa,
+                       struct waiter *w)
+{
+    struct waiter **bucket;
+
+    w->pa = pa;
+    w->handle = ++pac->next_handle;
+    if (w->handle == 0)
+        w->handle = ++pac->next_handle;
+    bucket = &pac->reqs[w->handle & (REQ_BUCKETS - 1)];
+    w->next_handle = *bucket;
+    *bucket = w;
+
+    w->next = NULL;
+    if (pa->last_waiter)
+        pa->last_waiter->next = w;
+    else
+        pa->waiters = w;
+    pa->last_waiter = w;
+}
+
+static void unlink_waiter(struct pac *pac, struct waiter *w)
+{
+    struct waiter **p;
+
+    for (p = &pac->reqs[w->handle & (REQ_BUCKETS - 1)]; *p;
+         p = &(*p)->next_handle) {
+        if (*p == w) {
+            *p = w->next_handle;
+            break;
+        }
+    }
+}
+
+/*
+ * Whether nobody is interested in the result of a lookup any more: every
+ * waiter cancelled it, or is past its deadline.
+ */
+static int lookup_aborted_locked(struct proxy_args *pa)
+{
+    unsigned long long now = 0;
+    struct waiter *w;
+
+    if (pa->aborted)
+        return 1;
+
+    for (w = pa->waiters; w; w = w->next) {
+        if (w->cancelled)
+            continue;
+        if (!w->deadline)
+            return 0;
+        if (!now)
+            now = util_now_ms();
+        if (now < w->deadline)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Check whether to give up on a lookup. Once given up on, it leaves the
+ * in-flight table, so that new submissions don't attach to it, and it
+ * stays given up on.
+ */
+static int lookup_aborted(struct proxy_args *pa)
+{
+    struct pac *pac = pa->pac;
+    int aborted;
+
+    pthread_mutex_lock(&pac->req_mtx);
+    aborted = lookup_aborted_locked(pa);
+    if (aborted) {
+        pa->aborted = 1;
+        unlink_inflight(pac, pa);
+    }
+    pthread_mutex_unlock(&pac->req_mtx);
+
+    return aborted;
+}
+
+/*
+ * Called by Duktape from the executor interrupt, see duk_config.h. A true
+ * return value makes the running evaluation throw a RangeError, and must
+ * keep doing so until the evaluation has unwound.
+ */
+duk_bool_t pac_exec_timeout_check(void *udata)
+{
+    struct pac_ctx *pc = udata;
+
+    if (!pc)
+        return 0;
+
+    if (pc->budget_end && util_now_ms() >= pc->budget_end)
+        pc->over_budget = 1;
+    if (!pc->over_budget && !(pc->req && lookup_aborted(pc->req)))
+        return 0;
+
+    pc->interrupted = 1;
+    return 1;
+}
+
+static void free_proxy_args(struct proxy_args *pa)
+{
+    if (pa->tenant)
+        tenant_unref(pa->pac, pa->tenant);
+    free(pa->url);
+    free(pa->host);
+    free(pa->result);
+    free(pa);
+}
+
+/* Deliver the result of a lookup to everybody waiting for it. */
+static void main_result(void *arg)
+{
+    struct proxy_args *pa = arg;
+    struct pac *pac = pa->pac;
+    struct waiter *w, *next;
+    unsigned long long now = util_now_ms();
+    unsigned long expired = 0;
+
+    if (pa->host != NULL) {
+        logw("Assertion error: pa->host == %p", pa->host);
+    }
+    if (pa->url != NULL) {
+        logw("Assertion error: pa->url == %p", pa->url);
+    }
+
+    /*
+     * The lookup already left the in-flight table, so the list of waiters
+     * is final. Once unlinked, pac_cancel() can't reach them either.
+     */
+    pthread_mutex_lock(&pac->req_mtx);
+    for (w = pa->waiters; w; w = w->next)
+        unlink_waiter(pac, w);
+    pthread_mutex_unlock(&pac->req_mtx);
+
+    for (w = pa->waiters; w; w = next) {
+        next = w->next;
+        if (!w->cancelled) {
+            /* Every callback owns its copy of the result. */
+            char *result = pa->result ? strdup(pa->result) : NULL;
+            if (!result && w->deadline && now >= w->deadline)
+                expired++;
+            w->cb(result, w->arg);
+        }
+        free(w);
+    }
+
+    if (expired) {
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.expired += expired;
+        pthread_mutex_unlock(&pac->stats_mtx);
+    }
+
+    free_proxy_args(pa);
+}
+
+static threadpool_t *lane_pool(struct pac *pac, int lane)
+{
+    if (lane == PAC_LANE_DNS && pac->dns_threadpool)
+        return pac->dns_threadpool;
+    return pac->threadpool;
+}
+
+static unsigned int hash_host(const char *host)
+{
+    return hash_str(FNV_OFFSET, host);
+}
+
+/* Pick a lane for a lookup based on how the last one for host behaved. */
+static int classify_lane(struct pac *pac, const char *host)
+{
+    unsigned int h = hash_host(host);
+    struct host_lane *hl = &pac->host_lanes[h & (HOST_LANES - 1)];
+    int lane = PAC_LANE_FAST;
+
+    pthread_mutex_lock(&pac->lane_mtx);
+    if (hl->hash == h && hl->lane)
+        lane = hl->lane;
+    pthread_mutex_unlock(&pac->lane_mtx);
+
+    return lane;
+}
+
+static void record_lane(struct pac *pac, const char *host, int resolved)
+{
+    unsigned int h = hash_host(host);
+    struct host_lane *hl = &pac->host_lanes[h & (HOST_LANES - 1)];
+
+    pthread_mutex_lock(&pac->lane_mtx);
+    hl->hash = h;
+    hl->lane = resolved ? PAC_LANE_DNS : PAC_LANE_FAST;
+    pthread_mutex_unlock(&pac->lane_mtx);
+}
+
+/* Find a script by ID, NULL meaning pac->tenant. Needs ctx_mtx held. */
+static struct tenant *find_tenant(struct pac *pac, const char *id)
+{
+    struct tenant *t;
+
+    if (!id)
+        return pac->tenant;
+
+    t = pac->tenants[hash_str(FNV_OFFSET, id) & (TENANT_BUCKETS - 1)];
+    for (; t; t = t->next)
+        if (!strcmp(t->id, id))
+            return t;
+
+    return NULL;
+}
+
+/*
+ * Take a free context running the script of t, preferring one allocated on
+ * the NUMA node the calling thread runs on. If there is none, a context is
+ * built for it, after freeing the least recently used idle context of
+ * another script if all max_ctx contexts exist. Waits if all of them are
+ * in use. Returns NULL if t has no script (any more).
+ */
+static struct pac_ctx *pop_context(struct pac *pac, struct tenant *t)
+{
+    struct pac_ctx **p, **found, **lru, *pc, *victim = NULL;
+    struct pac_script *script;
+    int node = current_node(pac);
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+
+    for (;;) {
+        script = t->script;
+        if (!script || script->retired) {
+            pthread_mutex_unlock(&pac->ctx_mtx);
+            return NULL;
+        }
+
+        found = lru = NULL;
+        for (p = &pac->idle; *p; p = &(*p)->next) {
+            /* Lookups are parked on it: not for eviction. */
+            if (!(*p)->parked)
+                lru = p;
+            if ((*p)->script != script)
+                continue;
+            if (!found || (node >= 0 && (*found)->node != node &&
+                           (*p)->node == node))
+                found = p;
+        }
+
+        if (!found) {
+            for (p = &pac->spares; *p; p = &(*p)->next) {
+                if ((*p)->script == script) {
+                    found = p;
+                    break;
+                }
+            }
+        }
+
+        if (found) {
+            pc = *found;
+            *found = pc->next;
+            pc->next = NULL;
+            pc->replaces = NULL;
+            pthread_mutex_unlock(&pac->ctx_mtx);
+            return pc;
+        }
+
+        if (pac->n_live < pac->max_ctx || lru)
+            break;
+
+        pthread_cond_wait(&pac->ctx_cond, &pac->ctx_mtx);
+    }
+
+    if (pac->n_live >= pac->max_ctx) {
+        victim = *lru;
+        *lru = victim->next;
+    }
+    pac->n_live++;
+    script->refs++;
+
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (victim) {
+        free_ctx(pac, victim);
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.evicted++;
+        pthread_mutex_unlock(&pac->stats_mtx);
+    }
+
+    pc = new_ctx(pac, script, node);
+    if (!pc) {
+        logw("Error creating PAC context.");
+        pthread_mutex_lock(&pac->ctx_mtx);
+        pac->n_live--;
+        pthread_cond_signal(&pac->ctx_cond);
+        pthread_mutex_unlock(&pac->ctx_mtx);
+    }
+    script_unref(pac, script);
+
+    return pc;
+}
+
+/* Whether pc served recycle_after lookups, or grew by recycle_growth. */
+static int worn_out(struct pac *pac, struct pac_ctx *pc)
+{
+    struct arena_stats stats;
+
+    if (pac->recycle_after > 0 && pc->evals >= pac->recycle_after)
+        return 1;
+
+    if (!pc->arena || !pac->recycle_growth)
+        return 0;
+
+    arena_get_stats(pc->arena, &stats);
+    return stats.bytes_live > pc->base_bytes + pac->recycle_growth;
+}
+
+struct rebuild_args {
+    struct pac *pac;
+    struct pac_script *script;
+    struct pac_ctx *origin; /* The worn out context, or NULL once freed. */
+    int slot;
+    int node;
+    struct rebuild_args *next; /* In pac->rebuilds. */
+};
+
+/*
+ * Called with ctx_mtx held when pc is freed: replacements built for it
+ * are up for grabs by any worn out context of the script. Only compares
+ * the pointer, which may be stale by now.
+ */
+static void forget_origin(struct pac *pac, struct pac_ctx *pc)
+{
+    struct rebuild_args *ra;
+    struct pac_ctx *spare;
+
+    for (ra = pac->rebuilds; ra; ra = ra->next)
+        if (ra->origin == pc)
+            ra->origin = NULL;
+    for (spare = pac->spares; spare; spare = spare->next)
+        if (spare->replaces == pc)
+            spare->replaces = NULL;
+}
+
+/* Called with ctx_mtx held: whether a replacement for pc is being built. */
+static int rebuild_pending(struct pac *pac, struct pac_ctx *pc)
+{
+    struct rebuild_args *ra;
+
+    for (ra = pac->rebuilds; ra; ra = ra->next)
+        if (ra->origin == pc)
+            return 1;
+
+    return 0;
+}
+
+/*
+ * Called with ctx_mtx held: take the spare built for pc, or one that no
+ * longer has a context to replace.
+ */
+static struct pac_ctx *take_spare(struct pac *pac, struct pac_ctx *pc)
+{
+    struct pac_ctx **p, *spare;
+
+    for (p = &pac->spares; *p; p = &(*p)->next) {
+        spare = *p;
+        if (spare->script != pc->script ||
+            (spare->replaces && spare->replaces != pc))
+            continue;
+        *p = spare->next;
+        spare->replaces = NULL;
+        return spare;
+    }
+
+    return NULL;
+}
+
+/*
+ * Build a fresh context to replace a worn out one, on the same CPU, and
+ * leave it among the spares for push_context() to swap in.
+ */
+static void rebuild_ctx(void *arg)
+{
+    struct rebuild_args *ra = arg, **p;
+    struct pac *pac = ra->pac;
+    struct pac_ctx *pc;
+
+    if (ra->slot >= 0)
+        pc = build_ctx_for_slot(pac, ra->script, ra->slot);
+    else
+        pc = new_ctx(pac, ra->script, ra->node);
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    for (p = &pac->rebuilds; *p != ra; p = &(*p)->next)
+        ;
+    *p = ra->next;
+    if (!pc) {
+        pac->n_live--;
+    } else if (!ra->script->retired) {
+        pc->replaces = ra->origin;
+        pc->next = pac->spares;
+        pac->spares = pc;
+        pc = NULL;
+    }
+    /* pop_context() may be waiting for room, or for this spare. */
+    pthread_cond_broadcast(&pac->ctx_cond);
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (pc)
+        free_ctx(pac, pc);
+    script_unref(pac, ra->script);
+    free(ra);
+}
+
+/*
+ * Return a context to the pool. Contexts of a script that has since been
+ * replaced or removed are freed instead, and so are contexts whose
+ * evaluation got interrupted, as it might have left the script's globals
+ * half updated. pop_context() builds a clean one when needed.
+ *
+ * Worn out contexts keep serving until a replacement has been built in
+ * the background, and are then swapped for it. If all max_ctx contexts
+ * exist, there is no room for that: they are freed right away instead,
+ * and pop_context() builds a fresh one when needed.
+ *
+ * Contexts to be freed that still have lookups parked on them are kept
+ * aside until these are done.
+ */
+static void push_context(struct pac *pac, struct pac_ctx *pc)
+{
+    struct pac_ctx *spare = NULL;
+    struct rebuild_args *ra = NULL;
+    int drop, recycled = 0;
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+
+    if (pc->script->retired || pc->interrupted)
+        pc->draining = 1;
+
+    if (!pc->draining && worn_out(pac, pc)) {
+        spare = take_spare(pac, pc);
+        if (!spare && !rebuild_pending(pac, pc)) {
+            if (pac->n_live < pac->max_ctx)
+                ra = calloc(1, sizeof(struct rebuild_args));
+            else
+                pc->draining = recycled = 1;
+        }
+        if (ra) {
+            ra->pac = pac;
+            ra->script = pc->script;
+            ra->origin = pc;
+            ra->slot = pc->slot;
+            ra->node = pc->node;
+            ra->script->refs++;
+            ra->next = pac->rebuilds;
+            pac->rebuilds = ra;
+            pac->n_live++;
+            /* Retried on the next return if the queue is full. */
+            if (threadpool_schedule(pac->threadpool, rebuild_ctx, ra) < 0) {
+                pac->rebuilds = ra->next;
+                ra->script->refs--;
+                pac->n_live--;
+                free(ra);
+            }
+        }
+    }
+
+    if (spare) {
+        spare->next = pac->idle;
+        pac->idle = spare;
+        pc->draining = recycled = 1;
+    }
+    drop = pc->draining && !pc->parked;
+    if (!pc->draining) {
+        pc->next = pac->idle;
+        pac->idle = pc;
+    } else if (!drop) {
+        pc->next = pac->draining;
+        pac->draining = pc;
+    }
+    /* Resolver threads may be waiting for this very context. */
+    if (pac->resolver_pool)
+        pthread_cond_broadcast(&pac->ctx_cond);
+    else
+        pthread_cond_signal(&pac->ctx_cond);
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (recycled) {
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.recycled++;
+        pthread_mutex_unlock(&pac->stats_mtx);
+    }
+    if (drop)
+        free_ctx(pac, pc);
+}
+
+/* Background construction of the contexts of a script. */
+struct warm_up_args {
+    struct pac *pac;
+    struct pac_script *script;
+    int next; /* Index of the next context to build. */
+};
+
+/*
+ * Build one more context and put it to use, then requeue ourselves, so
+ * that lookups submitted meanwhile get a turn. Stops early if the script
+ * has been replaced, and fires the readiness callback once all contexts
+ * are there, or the pool is full.
+ */
+static void warm_up(void *arg)
+{
+    struct warm_up_args *wa = arg;
+    struct pac *pac = wa->pac;
+    struct pac_ctx *pc;
+    int room;
+
+    while (wa->next < pac->n_ctx) {
+        pthread_mutex_lock(&pac->ctx_mtx);
+        if (wa->script->retired) {
+            pthread_mutex_unlock(&pac->ctx_mtx);
+            goto out;
+        }
+        room = pac->n_live < pac->max_ctx;
+        if (room)
+            pac->n_live++;
+        pthread_mutex_unlock(&pac->ctx_mtx);
+        if (!room)
+            break;
+
+        pc = build_ctx_for_slot(pac, wa->script, wa->next);
+        if (!pc) {
+            logw("Error creating PAC context #%d.", wa->next);
+            pthread_mutex_lock(&pac->ctx_mtx);
+            pac->n_live--;
+            pthread_mutex_unlock(&pac->ctx_mtx);
+            goto out;
+        }
+        push_context(pac, pc);
+
+        if (++wa->next == pac->n_ctx)
+            break;
+
+        /* Build the next one inline if the queue is full. */
+        if (threadpool_schedule(pac->threadpool, warm_up, wa) >= 0)
+            return;
+    }
+
+    if (pac->ready_cb)
+        threadpool_schedule_back(pac->threadpool, pac->ready_cb,
+                                 pac->ready_arg);
+
+out:
+    script_unref(pac, wa->script);
+    free(wa);
+}
+
+/* Move the contexts of script from one list to another. */
+static void move_script_ctxs(struct pac_ctx **from, struct pac_script *script,
+                             struct pac_ctx **to)
+{
+    struct pac_ctx *pc;
+
+    while (*from) {
+        pc = *from;
+        if (pc->script != script) {
+            from = &pc->next;
+            continue;
+        }
+        *from = pc->next;
+        pc->next = *to;
+        *to = pc;
+    }
+}
+
+/*
+ * Make script the current version of t, adding the already built context
+ * pc (if any) to the pool. For pac->tenant, its other contexts are built
+ * in the background. Returns the old version, and its idle contexts.
+ */
+static struct pac_script *install_script(struct pac *pac, struct tenant *t,
+                                         struct pac_script *script,
+                                         struct pac_ctx *pc,
+                                         struct pac_ctx **stale)
+{
+    struct warm_up_args *wa = NULL;
+    struct pac_script *old;
+    struct pac_ctx **p, *idle;
+
+    if (script && t == pac->tenant && pac->n_ctx > 1) {
+        wa = calloc(1, sizeof(struct warm_up_args));
+        if (wa) {
+            wa->pac = pac;
+            wa->script = script;
+            wa->next = 1;
+            script_ref(pac, script);
+        } else {
+            logw("Error allocating warm-up, running with one context.");
+        }
+    }
+
+    *stale = NULL;
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    old = t->script;
+    t->script = script;
+    if (old) {
+        old->retired = 1;
+        move_script_ctxs(&pac->idle, old, stale);
+        move_script_ctxs(&pac->spares, old, stale);
+        /* Keep the ones with parked lookups until these are done. */
+        for (p = stale; *p;) {
+            if (!(*p)->parked) {
+                p = &(*p)->next;
+                continue;
+            }
+            idle = *p;
+            *p = idle->next;
+            idle->draining = 1;
+            idle->next = pac->draining;
+            pac->draining = idle;
+        }
+    }
+    if (pc) {
+        pc->next = pac->idle;
+        pac->idle = pc;
+    }
+    pthread_cond_broadcast(&pac->ctx_cond);
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (!wa) {
+        if (script && t == pac->tenant && pac->n_ctx == 1 && pac->ready_cb)
+            threadpool_schedule_back(pac->threadpool, pac->ready_cb,
+                                     pac->ready_arg);
+    } else if (threadpool_schedule(pac->threadpool, warm_up, wa) < 0) {
+        warm_up(wa);
+    }
+
+    return old;
+}
+
+/*
+ * Evaluate FindProxyForURL() for pa in pc, interrupting it once it runs
+ * longer than max_exec_ms, and leave the result in pa. Time spent blocked
+ * in DNS lookups counts, but can't be interrupted.
+ *
+ * Lookups submitted with resolver threads (pc->req set) run in their own
+ * coroutine instead, and may park on a DNS query, which returns 1. They
+ * are then run again with its answer, and the budget applies to each run.
+ */
+static int run_find_proxy(struct pac *pac, struct pac_ctx *pc,
+                          struct proxy_args *pa)
+{
+    struct arena_stats before, after;
+    struct pac_mem_stats ms;
+    const char *rule_result;
+    char my_ip_buf[UTIL_BUFLEN], *my_ip_addr = NULL;
+    int parked = 0;
+
+    if (pc->script->rules && !pa->co && !pa->skip_rules) {
+        if (rules_use_my_ip(pc->script->rules)) {
+            my_ip(my_ip_buf, sizeof(my_ip_buf), RETURN_SINGLE_RESULT,
+                  pac->my_ip_ttl_ms);
+            my_ip_addr = my_ip_buf;
+        }
+        switch (rules_eval(pc->script->rules, pa->url, pa->host, my_ip_addr,
+                           &rule_result)) {
+        case RULES_MATCH:
+            pc->evals++;
+            pa->result = strdup(rule_result);
+
+            pthread_mutex_lock(&pac->stats_mtx);
+            pac->stats.rule_hits++;
+            pthread_mutex_unlock(&pac->stats_mtx);
+            return 0;
+        case RULES_MISS:
+            pa->skip_rules = 1;
+            break;
+        }
+    }
+
+    if (pc->arena)
+        arena_get_stats(pc->arena, &before);
+
+    pc->resolved = pa->resolved;
+    pc->over_budget = 0;
+    if (!pa->co)
+        pc->evals++;
+    if (pac->max_exec_ms > 0)
+        pc->budget_end = util_now_ms() + pac->max_exec_ms;
+    if (pac->resolver_pool && pc->req)
+        pa->result = step_find_proxy(pc, pa, &parked);
+    else
+        pa->result = find_proxy(pc->ctx, pa->url, pa->host, pa->skip_rules);
+    pc->budget_end = 0;
+    pa->resolved = pc->resolved;
+    if (pc->over_budget)
+        pa->over_budget = 1;
+
+    if (pc->arena) {
+        arena_get_stats(pc->arena, &after);
+        pa->allocs += after.allocs - before.allocs;
+        if (after.refused > before.refused) {
+            pa->over_memory = 1;
+            /* Don't keep a heap around that is full of live objects. */
+            pc->interrupted = 1;
+        }
+    }
+    if (parked)
+        return 1;
+
+    memset(&ms, 0, sizeof(ms));
+    if (pc->arena) {
+        ms.bytes_live = after.bytes_live;
+        ms.bytes_peak = after.bytes_peak;
+        ms.heap_bytes = after.chunk_bytes;
+        ms.allocs = pa->allocs;
+    }
+    if (pa->over_memory) {
+        logw("PAC context ran out of memory for host %s.", pa->host);
+        free(pa->result);
+        pa->result = NULL;
+
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.over_memory++;
+        pthread_mutex_unlock(&pac->stats_mtx);
+    }
+    if (pac->mem_stats_cb) {
+        ms.gc_count = pc->gc_count;
+        ms.gc_last_us = pc->gc_last_us;
+        ms.gc_max_us = pc->gc_max_us;
+        pac->mem_stats_cb(&ms, pac->mem_stats_arg);
+    }
+
+    if (pa->over_budget) {
+        logw("PAC script ran for more than %d ms for host %s.",
+             pac->max_exec_ms, pa->host);
+        free(pa->result);
+        pa->result = pac->exec_fallback ? strdup(pac->exec_fallback) : NULL;
+
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.over_budget++;
+        pthread_mutex_unlock(&pac->stats_mtx);
+    }
+
+    return 0;
+}
+
+/*
+ * Collect garbage in pc after a lookup, instead of during one: every
+ * gc_interval lookups, or when pool has nothing else to do.
+ */
+static void maybe_gc(struct pac *pac, threadpool_t *pool, struct pac_ctx *pc)
+{
+    unsigned long long start;
+    unsigned long pause;
+
+    /* Freed anyway. */
+    if (pc->interrupted)
+        return;
+
+    pc->since_gc++;
+    if (!(pac->gc_interval > 0 && pc->since_gc >= pac->gc_interval) &&
+        !(pac->gc_when_idle && threadpool_queued(pool) == 0))
+        return;
+
+    start = util_now_us();
+    duk_gc(pc->ctx, 0);
+    pause = util_now_us() - start;
+
+    pc->since_gc = 0;
+    pc->gc_count++;
+    pc->gc_last_us = pause;
+    if (pause > pc->gc_max_us)
+        pc->gc_max_us = pause;
+
+    pthread_mutex_lock(&pac->stats_mtx);
+    pac->stats.gc_runs++;
+    pac->stats.gc_pause_us += pause;
+    pthread_mutex_unlock(&pac->stats_mtx);
+}
+
+/*
+ * Deliver the result of pa via pool, and return pc (if any) to the pool
+ * of contexts.
+ */
+static void finish_lookup(struct pac *pac, threadpool_t *pool,
+                          struct pac_ctx *pc, struct proxy_args *pa)
+{
+    if (pa->result && pac->dns_threadpool)
+        record_lane(pac, pa->host, pa->resolved);
+
+    pthread_mutex_lock(&pac->req_mtx);
+    unlink_inflight(pac, pa);
+    pthread_mutex_unlock(&pac->req_mtx);
+
+    /* An aborted evaluation might have caught the error and carried on. */
+    if (pa->aborted) {
+        free(pa->result);
+        pa->result = NULL;
+    }
+
+    free(pa->host);
+    pa->host = NULL;
+    free(pa->url);
+    pa->url = NULL;
+
+    threadpool_schedule_back(pool, main_result, pa);
+
+    /* The result is on its way: tidy up the context before reusing it. */
+    if (pc) {
+        maybe_gc(pac, pool, pc);
+        push_context(pac, pc);
+    }
+}
+
+/*
+ * Evaluate pa in pc until it is done, then finish it. If it parks on a
+ * DNS query instead, pc goes back to the pool for other lookups to use,
+ * and resolve_host() resumes the lookup on it once the answer is in.
+ */
+static void eval_lookup(struct pac *pac, threadpool_t *pool,
+                        struct pac_ctx *pc, struct proxy_args *pa)
+{
+    int done;
+
+    for (;;) {
+        pc->req = pa;
+        done = !run_find_proxy(pac, pc, pa);
+        pc->req = NULL;
+        if (done)
+            break;
+
+        pc->parked++;
+        pa->pc = pc;
+        pthread_mutex_lock(&pac->dns_mtx);
+        done = pa->dns->done;
+        if (!done)
+            pa->dns->parked = 1;
+        pthread_mutex_unlock(&pac->dns_mtx);
+        if (!done) {
+            pthread_mutex_lock(&pac->stats_mtx);
+            pac->stats.parked++;
+            pthread_mutex_unlock(&pac->stats_mtx);
+
+            push_context(pac, pc);
+            return;
+        }
+
+        /* Answered already: carry on right away. */
+        pc->parked--;
+    }
+
+    finish_lookup(pac, pool, pc, pa);
+}
+
+static void _pac_find_proxy(void *arg)
+{
+    struct proxy_args *pa = arg;
+    struct pac *pac = pa->pac;
+    threadpool_t *pool = lane_pool(pac, pa->lane);
+    struct pac_ctx *pc;
+
+    /* Don't spend a context on lookups nobody is waiting for any more. */
+    if (!lookup_aborted(pa)) {
+        pc = pop_context(pac, pa->tenant);
+        if (pc) {
+            eval_lookup(pac, pool, pc, pa);
+            return;
+        }
+    }
+
+    finish_lookup(pac, pool, NULL, pa);
+}
+
+/* Unlink pc from a list of contexts. Returns 0 if it is not on it. */
+static int unlink_ctx(struct pac_ctx **list, struct pac_ctx *pc)
+{
+    for (; *list; list = &(*list)->next) {
+        if (*list == pc) {
+            *list = pc->next;
+            pc->next = NULL;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Resolver thread: answer the query of a parked lookup, and resume the
+ * lookup in its context, once whoever uses the context returns it. If the
+ * lookup did not park, it picks up the answer itself.
+ */
+static void resolve_host(void *arg)
+{
+    struct dns_query *q = arg;
+    struct pac *pac = q->pac;
+    struct proxy_args *pa;
+    struct pac_ctx *pc;
+    int parked;
+
+    pthread_mutex_lock(&pac->dns_mtx);
+    if (q->abandoned) {
+        pthread_mutex_unlock(&pac->dns_mtx);
+        free(q);
+        return;
+    }
+    q->running = 1;
+    pthread_mutex_unlock(&pac->dns_mtx);
+
+    if (util_dns_resolve(q->host, q->result, sizeof(q->result),
+                         q->all_results) < 0)
+        q->result[0] = '\0';
+
+    pthread_mutex_lock(&pac->dns_mtx);
+    q->done = 1;
+    parked = q->parked;
+    if (!parked)
+        pthread_cond_broadcast(&pac->dns_cond);
+    pthread_mutex_unlock(&pac->dns_mtx);
+
+    if (!parked)
+        return;
+
+    pa = q->pa;
+    pc = pa->pc;
+    pthread_mutex_lock(&pac->ctx_mtx);
+    while (!unlink_ctx(&pac->idle, pc) && !unlink_ctx(&pac->draining, pc))
+        pthread_cond_wait(&pac->ctx_cond, &pac->ctx_mtx);
+    pthread_mutex_unlock(&pac->ctx_mtx);
+    pc->parked--;
+
+    eval_lookup(pac, pac->resolver_pool, pc, pa);
+}
+
+/*
+ * The queue is full: count the lookup as shed and answer it with the
+ * fallback (still via the main loop, never from within pac_find_proxy()),
+ * or count it as rejected and let the caller know. Called with req_mtx
+ * held.
+ */
+static int shed_load(struct pac *pac, struct proxy_args *pa)
+{
+    if (pac->fallback) {
+        free(pa->url);
+        pa->url = NULL;
+        free(pa->host);
+        pa->host = NULL;
+        pa->result = strdup(pac->fallback);
+        if (pa->result &&
+            threadpool_schedule_back(pac->threadpool, main_result, pa) == 0) {
+            pthread_mutex_lock(&pac->stats_mtx);
+            pac->stats.shed++;
+            pthread_mutex_unlock(&pac->stats_mtx);
+            return 0;
+        }
+    }
+
+    pthread_mutex_lock(&pac->stats_mtx);
+    pac->stats.rejected++;
+    pthread_mutex_unlock(&pac->stats_mtx);
+
+    errno = EAGAIN;
+    return -1;
+}
+
+void pac_req_opts_init(struct pac_req_opts *ro)
+{
+    memset(ro, 0, sizeof(*ro));
+}
+
+int pac_find_proxy(struct pac *pac, char *url, char *host,
+                   void (*cb)(char *_result, void *_arg), void *arg)
+{
+    return pac_find_proxy_ex(pac, url, host, NULL, cb, arg);
+}
+
+int pac_find_proxy_ex(struct pac *pac, char *url, char *host,
+                      struct pac_req_opts *ro,
+                      void (*cb)(char *_result, void *_arg), void *arg)
+{
+    struct proxy_args *pa = calloc(1, sizeof(struct proxy_args)), *other;
+    struct waiter *w = calloc(1, sizeof(struct waiter));
+    threadpool_t *pool;
+    int ret = 0;
+
+    if (!pa || !w) {
+        logw("Failed to allocate proxy arguments.");
         goto err;
     }
 
-    for (i = 0; i < pac->n_ctx; i++) {
-        pac->ctx[i] = alloc_ctx(js);
-        if (!pac->ctx[i]) {
-            logw("Error creating PAC context #%d.", i);
-            goto err;
+    pa->pac = pac;
+    pa->url = strdup(url);
+    pa->host = strdup(host);
+    pa->hash = hash_lookup(url, host);
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    pa->tenant = find_tenant(pac, ro ? ro->script_id : NULL);
+    if (pa->tenant)
+        pa->tenant->refs++;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+    if (!pa->tenant) {
+        logd("Unknown script %s.", ro->script_id);
+        errno = ENOENT;
+        goto err;
+    }
+
+    w->arg = arg;
+    w->cb = cb;
+    if (ro && ro->timeout_ms > 0)
+        w->deadline = util_now_ms() + ro->timeout_ms;
+
+    if (!pa->url || !pa->host) {
+        logw("Failed to allocate proxy arguments.");
+        goto err;
+    }
+
+    pthread_mutex_lock(&pac->req_mtx);
+
+    /* Piggyback on an identical lookup that is queued or running. */
+    other = find_inflight(pac, pa->tenant, pa->hash, url, host);
+    if (other) {
+        add_waiter(pac, other, w);
+        if (ro)
+            ro->handle = w->handle;
+        pthread_mutex_unlock(&pac->req_mtx);
+
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.coalesced++;
+        pthread_mutex_unlock(&pac->stats_mtx);
+
+        free_proxy_args(pa);
+        return 0;
+    }
+
+    pa->lane = ro ? ro->lane : PAC_LANE_AUTO;
+    if (pa->lane == PAC_LANE_AUTO)
+        pa->lane = pac->dns_threadpool ? classify_lane(pac, host)
+                                       : PAC_LANE_FAST;
+
+    pa->generation = pac->generation;
+    add_waiter(pac, pa, w);
+    if (ro)
+        ro->handle = w->handle;
+    link_inflight(pac, pa);
+
+    /*
+     * Still holding req_mtx, so that nobody attaches to the lookup before
+     * we know whether it could be queued.
+     */
+    pool = lane_pool(pac, pa->lane);
+    if (threadpool_schedule(pool, _pac_find_proxy, pa) < 0) {
+        unlink_inflight(pac, pa);
+        if (errno == EAGAIN) {
+            ret = shed_load(pac, pa);
+        } else {
+            logw("Failed to schedule work item.");
+            ret = -1;
+        }
+        if (ret < 0)
+            unlink_waiter(pac, w);
+        pthread_mutex_unlock(&pac->req_mtx);
+        if (ret < 0) {
+            free(w);
+            free_proxy_args(pa);
+        }
+        return ret;
+    }
+
+    pthread_mutex_unlock(&pac->req_mtx);
+
+    if (pool == pac->dns_threadpool) {
+        pthread_mutex_lock(&pac->stats_mtx);
+        pac->stats.dns_lane++;
+        pthread_mutex_unlock(&pac->stats_mtx);
+    }
+
+    return 0;
+
+err:
+    free(w);
+    if (pa)
+        free_proxy_args(pa);
+    return -1;
+}
+
+int pac_find_proxy_sync(char *js, char *url, char *host, char **proxy)
+{
+    duk_context *ctx = alloc_ctx(js);
+    if (ctx) {
+        *proxy = find_proxy(ctx, url, host, 0);
+        duk_destroy_heap(ctx);
+        return 0;
+    } else {
+        logw("Failed to allocate JS context.");
+        return -1;
+    }
+}
+
+/*
+ * Cancel a pending lookup: its callback won't be called, and it is dropped
+ * or interrupted as soon as possible. Returns -1 if the handle is unknown,
+ * e.g. because the callback already ran. Call this from the thread that
+ * runs pac_run_callbacks(), otherwise the callback might still be running.
+ */
+int pac_cancel(struct pac *pac, unsigned long handle)
+{
+    struct waiter *w;
+
+    pthread_mutex_lock(&pac->req_mtx);
+    for (w = pac->reqs[handle & (REQ_BUCKETS - 1)]; w; w = w->next_handle)
+        if (w->handle == handle && !w->cancelled)
+            break;
+    if (w)
+        w->cancelled = 1;
+    pthread_mutex_unlock(&pac->req_mtx);
+
+    if (!w)
+        return -1;
+
+    pthread_mutex_lock(&pac->stats_mtx);
+    pac->stats.cancelled++;
+    pthread_mutex_unlock(&pac->stats_mtx);
+
+    return 0;
+}
+
+/*
+ * Synchronous lookup on an initialized PAC: borrows one of its contexts
+ * and evaluates on the calling thread, without going through the
+ * threadpool or the callback queue. Safe to call from any thread.
+ */
+int pac_find_proxy_blocking(struct pac *pac, char *url, char *host,
+                            char **proxy)
+{
+    struct pac_ctx *pc = pop_context(pac, pac->tenant);
+    struct proxy_args pa;
+
+    if (!pc)
+        return -1;
+
+    memset(&pa, 0, sizeof(pa));
+    pa.pac = pac;
+    pa.url = url;
+    pa.host = host;
+    run_find_proxy(pac, pc, &pa);
+    *proxy = pa.result;
+    if (*proxy && pac->dns_threadpool)
+        record_lane(pac, host, pa.resolved);
+
+    maybe_gc(pac, pac->threadpool, pc);
+    push_context(pac, pc);
+
+    return 0;
+}
+
+void pac_run_callbacks(struct pac *pac)
+{
+    threadpool_run_callbacks(pac->threadpool);
+    if (pac->dns_threadpool)
+        threadpool_run_callbacks(pac->dns_threadpool);
+    if (pac->resolver_pool)
+        threadpool_run_callbacks(pac->resolver_pool);
+}
+
+void pac_get_stats(struct pac *pac, struct pac_stats *stats)
+{
+    pthread_mutex_lock(&pac->stats_mtx);
+    *stats = pac->stats;
+    pthread_mutex_unlock(&pac->stats_mtx);
+}
+
+/*
+ * Make script the current version of t. For pac->tenant, its first
+ * context is built before it goes live. Consumes the reference to script,
+ * which may be NULL to remove the script of t.
+ */
+static int set_script(struct pac *pac, struct tenant *t,
+                      struct pac_script *script)
+{
+    struct pac_script *old;
+    struct pac_ctx *pc = NULL, *stale;
+
+    if (script && t == pac->tenant) {
+        pthread_mutex_lock(&pac->ctx_mtx);
+        pac->n_live++;
+        pthread_mutex_unlock(&pac->ctx_mtx);
+
+        pc = build_ctx_for_slot(pac, script, 0);
+        if (!pc) {
+            logw("Error creating PAC context.");
+            pthread_mutex_lock(&pac->ctx_mtx);
+            pac->n_live--;
+            pthread_mutex_unlock(&pac->ctx_mtx);
+            script_unref(pac, script);
+            errno = ENOMEM;
+            return -1;
         }
     }
 
-    if (pthread_mutex_init(&pac->ctx_mtx, NULL)) {
+    old = install_script(pac, t, script, pc, &stale);
+
+    /* New submissions must not join lookups of the old version. */
+    pthread_mutex_lock(&pac->req_mtx);
+    pac->generation++;
+    pthread_mutex_unlock(&pac->req_mtx);
+
+    free_ctx_list(pac, stale);
+    if (old)
+        script_unref(pac, old);
+
+    return 0;
+}
+
+static void stop_threadpool(threadpool_t *tp)
+{
+    while (!threadpool_die(tp, 1))
+        threadpool_run_callbacks(tp);
+    threadpool_run_callbacks(tp);
+    threadpool_destroy(tp);
+}
+
+static int init_locks(struct pac *pac)
+{
+    if (pthread_mutex_init(&pac->ctx_mtx, NULL))
+        goto err;
+    if (pthread_cond_init(&pac->ctx_cond, NULL))
+        goto err_ctx_mtx;
+    if (pthread_mutex_init(&pac->stats_mtx, NULL))
+        goto err_ctx_cond;
+    if (pthread_mutex_init(&pac->lane_mtx, NULL))
+        goto err_stats_mtx;
+    if (pthread_mutex_init(&pac->req_mtx, NULL))
+        goto err_lane_mtx;
+    if (pthread_mutex_init(&pac->dns_mtx, NULL))
+        goto err_req_mtx;
+    if (pthread_cond_init(&pac->dns_cond, NULL))
+        goto err_dns_mtx;
+    return 0;
+
+err_dns_mtx:
+    pthread_mutex_destroy(&pac->dns_mtx);
+err_req_mtx:
+    pthread_mutex_destroy(&pac->req_mtx);
+err_lane_mtx:
+    pthread_mutex_destroy(&pac->lane_mtx);
+err_stats_mtx:
+    pthread_mutex_destroy(&pac->stats_mtx);
+err_ctx_cond:
+    pthread_cond_destroy(&pac->ctx_cond);
+err_ctx_mtx:
+    pthread_mutex_destroy(&pac->ctx_mtx);
+err:
+    return -1;
+}
+
+static void destroy_locks(struct pac *pac)
+{
+    pthread_mutex_destroy(&pac->ctx_mtx);
+    pthread_cond_destroy(&pac->ctx_cond);
+    pthread_mutex_destroy(&pac->stats_mtx);
+    pthread_mutex_destroy(&pac->lane_mtx);
+    pthread_mutex_destroy(&pac->req_mtx);
+    pthread_mutex_destroy(&pac->dns_mtx);
+    pthread_cond_destroy(&pac->dns_cond);
+}
+
+void pac_opts_init(struct pac_opts *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+}
+
+struct pac *pac_init(char *js, int n_threads, void (*notify_cb)(void *),
+                     void *arg)
+{
+    return pac_init_opts(js, n_threads, notify_cb, arg, NULL);
+}
+
+struct pac *pac_init_opts(char *js, int n_threads, void (*notify_cb)(void *),
+                          void *arg, const struct pac_opts *opts)
+{
+    struct pac *pac = NULL;
+    struct pac_script *script = NULL;
+    int i, locks = 0;
+
+    /* Without a script, every lookup has to name one. */
+    if (opts && opts->rom_script) {
+        script = rom_script(opts->compile_rules);
+        if (!script)
+            goto err;
+    } else if (js) {
+        script = compile_script(js, opts && opts->compile_rules);
+        if (!script)
+            goto err;
+    }
+
+    pac = calloc(1, sizeof(struct pac));
+    if (!pac) {
+        logw("Error allocating PAC.");
+        goto err;
+    }
+
+    if (init_locks(pac) < 0) {
         logw("Error initializing mutex.");
         goto err;
     }
+    locks = 1;
+
+    pac->tenant = calloc(1, sizeof(struct tenant));
+    if (!pac->tenant) {
+        logw("Error allocating PAC.");
+        goto err;
+    }
+    pac->tenant->refs = 1;
+
+    /* One context per worker thread, plus extra ones to borrow. */
+    pac->n_ctx = n_threads;
+    if (opts)
+        pac->n_ctx += opts->dns_threads + opts->sync_contexts;
+    pac->max_ctx = pac->n_ctx;
+    if (opts && opts->max_contexts > 0)
+        pac->max_ctx = opts->max_contexts;
+    pac->threadpool = threadpool_create(n_threads, notify_cb, arg);
+    if (!pac->threadpool) {
+        logw("Error setting up PAC.");
+        goto err;
+    }
+
+    if (opts && opts->dns_threads > 0) {
+        pac->dns_threadpool = threadpool_create(opts->dns_threads,
+                                                notify_cb, arg);
+        if (!pac->dns_threadpool) {
+            logw("Error setting up DNS lane.");
+            goto err;
+        }
+    }
+
+    if (opts && opts->resolver_threads > 0) {
+        pac->resolver_pool = threadpool_create(opts->resolver_threads,
+                                               notify_cb, arg);
+        if (!pac->resolver_pool) {
+            logw("Error setting up resolver threads.");
+            goto err;
+        }
+    }
+
+    if (opts && opts->n_cpus > 0) {
+        pac->cpus = malloc(opts->n_cpus * sizeof(int));
+        pac->cpu_nodes = malloc(opts->n_cpus * sizeof(int));
+        if (!pac->cpus || !pac->cpu_nodes) {
+            logw("Error allocating CPU set.");
+            goto err;
+        }
+        pac->n_cpus = opts->n_cpus;
+        for (i = 0; i < pac->n_cpus; i++) {
+            pac->cpus[i] = opts->cpus[i];
+            pac->cpu_nodes[i] = util_cpu_node(opts->cpus[i]);
+        }
+        if (threadpool_set_affinity(pac->threadpool, pac->cpus,
+                                    pac->n_cpus) < 0 ||
+            (pac->dns_threadpool &&
+             threadpool_set_affinity(pac->dns_threadpool, pac->cpus,
+                                     pac->n_cpus) < 0))
+            logw("CPU affinity is not supported, workers will float.");
+    }
+
+    if (opts && opts->queue_limit > 0) {
+        threadpool_set_max_queued(pac->threadpool, opts->queue_limit);
+        if (pac->dns_threadpool)
+            threadpool_set_max_queued(pac->dns_threadpool,
+                                      opts->queue_limit);
+    }
+    if (opts && opts->fallback) {
+        pac->fallback = strdup(opts->fallback);
+        if (!pac->fallback) {
+            logw("Error allocating fallback proxy.");
+            goto err;
+        }
+    }
+    if (opts && (opts->arena || opts->max_heap_bytes ||
+                 opts->recycle_growth)) {
+        pac->arena = 1;
+        pac->huge_pages = opts->huge_pages;
+        pac->max_heap_bytes = opts->max_heap_bytes;
+    }
+    if (opts) {
+        pac->gc_interval = opts->gc_interval;
+        pac->gc_when_idle = opts->gc_when_idle;
+        pac->recycle_after = opts->recycle_after;
+        pac->recycle_growth = opts->recycle_growth;
+        pac->compile_rules = opts->compile_rules;
+        pac->my_ip_ttl_ms = opts->my_ip_ttl_ms;
+        pac->mem_stats_cb = opts->mem_stats_cb;
+        pac->mem_stats_arg = opts->mem_stats_arg;
+    }
+#if defined(PAC_NO_VOLUNTARY_GC)
+    /* Nothing else collects cyclic garbage, short of running out. */
+    if (pac->gc_interval <= 0 && !pac->gc_when_idle)
+        pac->gc_interval = 100;
+#endif
+    if (opts && opts->max_exec_ms > 0) {
+        pac->max_exec_ms = opts->max_exec_ms;
+        if (opts->exec_fallback) {
+            pac->exec_fallback = strdup(opts->exec_fallback);
+            if (!pac->exec_fallback) {
+                logw("Error allocating fallback proxy.");
+                goto err;
+            }
+        }
+    }
+
+    if (opts) {
+        pac->ready_cb = opts->ready_cb;
+        pac->ready_arg = opts->ready_arg;
+    }
+
+    if (script) {
+        i = set_script(pac, pac->tenant, script);
+        script = NULL;
+        if (i < 0)
+            goto err;
+    }
 
     return pac;
 
 err:
-    if (pac && pac->javascript)
-        free(pac->javascript);
-    if (pac && pac->ctx) {
-        for (i = 0; i < n_threads; i++)
-            if (pac->ctx[i])
-                duk_destroy_heap(pac->ctx[i]);
-        free(pac->ctx);
-    }
+    /* No script was installed, so the threads are idle. */
+    if (pac && pac->dns_threadpool)
+        stop_threadpool(pac->dns_threadpool);
     if (pac && pac->threadpool)
-        threadpool_die(pac->threadpool, 1);
-    if (pac)
+        stop_threadpool(pac->threadpool);
+    if (pac && pac->resolver_pool)
+        stop_threadpool(pac->resolver_pool);
+    if (pac) {
+        if (locks)
+            destroy_locks(pac);
+        free(pac->tenant);
+        free(pac->cpus);
+        free(pac->cpu_nodes);
+        free(pac->fallback);
+        free(pac->exec_fallback);
         free(pac);
+    }
+    if (script)
+        free_script(script);
     return NULL;
 }
 
+/*
+ * Replace the PAC script. The new script is compiled once, and its
+ * contexts are built from the bytecode: the first one before the script
+ * goes live, the rest in the background. Lookups already running finish
+ * on the old version, whose contexts are freed as they come back; later
+ * lookups see the new one. On error, the old script stays in place.
+ */
+int pac_reload(struct pac *pac, char *js)
+{
+    struct pac_script *script = compile_script(js, pac->compile_rules);
+
+    if (!script)
+        return -1;
+
+    return set_script(pac, pac->tenant, script);
+}
+
+/*
+ * Add a script, or replace the one with the same ID, for lookups naming
+ * it in pac_req_opts.script_id. Its contexts are built on demand, see
+ * pop_context().
+ */
+int pac_add_script(struct pac *pac, const char *id, char *js)
+{
+    struct pac_script *script;
+    struct tenant *t, *other, **bucket;
+    int ret;
+
+    if (!id)
+        return pac_reload(pac, js);
+
+    script = compile_script(js, pac->compile_rules);
+    if (!script)
+        return -1;
+
+    t = calloc(1, sizeof(struct tenant));
+    if (t)
+        t->id = strdup(id);
+    if (!t || !t->id) {
+        logw("Error allocating script %s.", id);
+        free(t);
+        free_script(script);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    other = find_tenant(pac, id);
+    if (other) {
+        free(t->id);
+        free(t);
+        t = other;
+    } else {
+        t->refs = 1;
+        bucket = &pac->tenants[hash_str(FNV_OFFSET, id) &
+                               (TENANT_BUCKETS - 1)];
+        t->next = *bucket;
+        *bucket = t;
+    }
+    t->refs++;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    ret = set_script(pac, t, script);
+    tenant_unref(pac, t);
+
+    return ret;
+}
+
+/*
+ * Remove a script added by pac_add_script(). Lookups for it that are still
+ * queued get a NULL result.
+ */
+int pac_remove_script(struct pac *pac, const char *id)
+{
+    struct tenant **p, *t;
+
+    if (!id) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&pac->ctx_mtx);
+    p = &pac->tenants[hash_str(FNV_OFFSET, id) & (TENANT_BUCKETS - 1)];
+    for (; *p && strcmp((*p)->id, id); p = &(*p)->next)
+        ;
+    t = *p;
+    if (t)
+        *p = t->next;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (!t) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    set_script(pac, t, NULL);
+    tenant_unref(pac, t);
+
+    return 0;
+}
+
+/* Unlink all scripts. Needs ctx_mtx held. */
+static struct tenant *take_tenants(struct pac *pac)
+{
+    struct tenant *list = pac->tenant, *t;
+    int i;
+
+    list->next = NULL;
+    for (i = 0; i < TENANT_BUCKETS; i++) {
+        while ((t = pac->tenants[i])) {
+            pac->tenants[i] = t->next;
+            t->next = list;
+            list = t;
+        }
+    }
+
+    return list;
+}
+
+/*
+ * Free a PAC. Waits for queued lookups, and runs their callbacks (with a
+ * NULL result for those that haven't started yet) before returning.
+ */
 void pac_free(struct pac *pac)
 {
-    free(pac->javascript);
-    duk_destroy_heap(*pac->ctx);
-    threadpool_die(pac->threadpool, 1);
+    struct tenant *tenants, *t;
+
+    /* Stop the warm-up, and have contexts freed as they come back. */
+    pthread_mutex_lock(&pac->ctx_mtx);
+    tenants = take_tenants(pac);
+    for (t = tenants; t; t = t->next)
+        if (t->script)
+            t->script->retired = 1;
+    pthread_mutex_unlock(&pac->ctx_mtx);
+
+    if (pac->dns_threadpool)
+        stop_threadpool(pac->dns_threadpool);
+    stop_threadpool(pac->threadpool);
+    /* Lookups parked on DNS finish on the resolver threads. */
+    if (pac->resolver_pool)
+        stop_threadpool(pac->resolver_pool);
+    free_ctx_list(pac, pac->idle);
+    free_ctx_list(pac, pac->spares);
+    free_ctx_list(pac, pac->draining);
+
+    while ((t = tenants)) {
+        tenants = t->next;
+        if (t->script)
+            script_unref(pac, t->script);
+        tenant_unref(pac, t);
+    }
+
+    destroy_locks(pac);
+    free(pac->cpus);
+    free(pac->cpu_nodes);
+    free(pac->fallback);
+    free(pac->exec_fallback);
     free(pac);
 }
@@ -1,11 +1,207 @@
+#include <stddef.h>
+
 struct pac;
 
+/*
+ * Memory use of a context, see pac_opts.mem_stats_cb. The byte and
+ * allocation counts need pac_opts.arena, and are 0 otherwise.
+ */
+struct pac_mem_stats {
+    unsigned long bytes_live; /* Allocated by the JS heap. */
+    unsigned long bytes_peak;
+    unsigned long heap_bytes; /* Taken from the system for small blocks. */
+    unsigned long allocs;     /* Allocations made by the last lookup. */
+    unsigned long gc_count;   /* Collections run between lookups. */
+    unsigned long gc_last_us; /* Pause of the last one. */
+    unsigned long gc_max_us;  /* Longest pause. */
+};
+
+/*
+ * Optional settings for pac_init_opts(). Always initialize with
+ * pac_opts_init() before setting fields, so new fields get their defaults.
+ */
+struct pac_opts {
+    /*
+     * CPUs to pin the worker threads to. Each JS context is allocated on
+     * the NUMA node of the CPU it is assigned to, and workers prefer
+     * contexts from their own node. NULL/0 lets workers float.
+     */
+    const int *cpus;
+    int n_cpus;
+    /*
+     * Maximum number of lookups waiting for a worker; 0 means unbounded.
+     * When the queue is full, pac_find_proxy() fails with errno set to
+     * EAGAIN, or, if fallback is set, immediately answers with a copy of
+     * the fallback string (e.g. "DIRECT") instead.
+     */
+    int queue_limit;
+    const char *fallback;
+    /*
+     * Extra worker threads (and contexts) for lookups that resolve host
+     * names, the "DNS lane". The n_threads passed to pac_init_opts() then
+     * only serve the "fast lane" of pure string lookups, so these never
+     * wait behind DNS round trips. 0 puts all lookups into one queue.
+     */
+    int dns_threads;
+    /*
+     * Extra contexts for pac_find_proxy_blocking() callers, so that they
+     * don't have to wait for (or hold up) the workers.
+     */
+    int sync_contexts;
+    /*
+     * Suspend lookups while their script waits for dnsResolve(): the host
+     * goes to one of this many resolver threads, and the worker carries
+     * on with other lookups. The resolver thread resumes the lookup once
+     * the answer is in. 0 resolves on the worker, blocking it. Resolver
+     * threads use the blocking getaddrinfo(), and wait for the context of
+     * the lookup to be free to resume it, so at most this many lookups
+     * are waiting for DNS answers at a time; more queue up for a thread.
+     */
+    int resolver_threads;
+    /*
+     * pac_init_opts() and pac_reload() return as soon as one context is
+     * ready, and build the others in the background; lookups are served
+     * by the contexts built so far. ready_cb is then called (from
+     * pac_run_callbacks(), like results) once all contexts exist.
+     */
+    void (*ready_cb)(void *arg);
+    void *ready_arg;
+    /*
+     * Maximum number of contexts, for all scripts together (see
+     * pac_add_script()). When a script needs one and all exist, the least
+     * recently used idle context of another script is freed. 0 means one
+     * per worker thread, plus sync_contexts.
+     */
+    int max_contexts;
+    /*
+     * Interrupt evaluations running longer than this many milliseconds
+     * (0: no limit), e.g. because of an endless loop in the script. They
+     * get a copy of exec_fallback as result, or NULL, and their context
+     * is replaced by a fresh one.
+     */
+    int max_exec_ms;
+    const char *exec_fallback;
+    /*
+     * Give every JS heap its own allocator, instead of going through the
+     * process-wide malloc(): small blocks come from private chunks, with
+     * free lists per size class. With huge_pages, chunks are 2 MB huge
+     * pages if possible.
+     */
+    int arena;
+    int huge_pages;
+    /*
+     * Limit the memory of each JS heap (implies arena). Lookups needing
+     * more fail with a NULL result, and their context is replaced.
+     */
+    size_t max_heap_bytes;
+    /*
+     * Run the garbage collector of a context between lookups, so that it
+     * doesn't kick in during one: after every gc_interval lookups on it,
+     * and/or (gc_when_idle) whenever no more lookups are queued. Build
+     * with --disable-voluntary-gc to keep Duktape from collecting on its
+     * own; gc_interval then defaults to 100.
+     */
+    int gc_interval;
+    int gc_when_idle;
+    /*
+     * Replace a context once it served recycle_after lookups, or its heap
+     * grew by recycle_growth bytes since loading the script (implies
+     * arena), to keep long running processes from slowly growing. The
+     * replacement is built in the background from the compiled script,
+     * while the old context keeps serving, unless max_contexts leaves no
+     * room for it: the old context is then freed right away.
+     */
+    int recycle_after;
+    size_t recycle_growth;
+    /*
+     * Answer lookups natively where possible: the rules FindProxyForURL()
+     * starts with, like "if (dnsDomainIs(host, ".example.com")) return
+     * ...;", are compiled when the script is loaded, and only lookups none
+     * of them matches run the rest of the script. Scripts that might not
+     * behave as assumed (e.g. redefining the helpers) run as before.
+     */
+    int compile_rules;
+    /*
+     * Run the PAC script built into the library (configure
+     * --with-rom-pac=file.js) instead of the one passed to
+     * pac_init_opts(), which may be NULL. Its bytecode was produced at
+     * build time, so it isn't parsed, but every context still loads its
+     * own copy of it. Fails with ENOENT if the library has none.
+     */
+    int rom_script;
+    /*
+     * Reuse the addresses of this host, as myIpAddress() (and compiled
+     * rules using it) see them, for this many milliseconds before asking
+     * the system again. The cache is shared by the whole process; call
+     * pac_network_changed() when the network configuration changes. 0
+     * asks the system on every call.
+     */
+    int my_ip_ttl_ms;
+    /* Called from the evaluating thread after each lookup. */
+    void (*mem_stats_cb)(const struct pac_mem_stats *stats, void *arg);
+    void *mem_stats_arg;
+};
+
+/* Lanes for struct pac_req_opts. */
+#define PAC_LANE_AUTO 0 /* Guess from earlier lookups for the same host. */
+#define PAC_LANE_FAST 1 /* The lookup won't resolve names. */
+#define PAC_LANE_DNS  2 /* The lookup will probably resolve names. */
+
+/* Per-lookup settings for pac_find_proxy_ex(), see pac_req_opts_init(). */
+struct pac_req_opts {
+    /* Script added by pac_add_script(), or NULL for the pac_init() one. */
+    const char *script_id;
+    int lane;
+    /*
+     * Give up on the lookup after this many milliseconds (0: never). An
+     * expired lookup is dropped before it runs, or interrupted while
+     * running, and its callback gets a NULL result.
+     */
+    int timeout_ms;
+    /* Out: set by pac_find_proxy_ex(), to be passed to pac_cancel(). */
+    unsigned long handle;
+};
+
+/* Counters, see pac_get_stats(). */
+struct pac_stats {
+    unsigned long rejected; /* Lookups refused with EAGAIN. */
+    unsigned long shed;     /* Lookups answered with the fallback. */
+    unsigned long dns_lane; /* Lookups run in the DNS lane. */
+    unsigned long expired;  /* Lookups that ran out of time. */
+    unsigned long cancelled; /* Lookups cancelled via pac_cancel(). */
+    unsigned long coalesced; /* Lookups that joined an identical one. */
+    unsigned long evicted;  /* Contexts freed to make room for others. */
+    unsigned long over_budget; /* Evaluations exceeding max_exec_ms. */
+    unsigned long over_memory; /* Evaluations exceeding max_heap_bytes. */
+    unsigned long gc_runs;  /* Collections run between lookups. */
+    unsigned long gc_pause_us; /* Time spent in them. */
+    unsigned long recycled; /* Worn out contexts replaced. */
+    unsigned long parked;   /* Lookups suspended for DNS answers. */
+    unsigned long rule_hits; /* Lookups answered by compiled rules. */
+};
+
+void pac_opts_init(struct pac_opts *opts);
 struct pac *pac_init(char *js, int n_threads, void (*notify_cb)(void *),
                      void *arg);
+struct pac *pac_init_opts(char *js, int n_threads, void (*notify_cb)(void *),
+                          void *arg, const struct pac_opts *opts);
+int pac_reload(struct pac *pac, char *js);
+int pac_add_script(struct pac *pac, const char *id, char *js);
+int pac_remove_script(struct pac *pac, const char *id);
+void pac_free(struct pac *pac);
 int pac_find_proxy(struct pac *pac, char *url, char *host,
                    void (*cb)(char *_result, void *_arg), void *arg);
+void pac_req_opts_init(struct pac_req_opts *ro);
+int pac_find_proxy_ex(struct pac *pac, char *url, char *host,
+                      struct pac_req_opts *ro,
+                      void (*cb)(char *_result, void *_arg), void *arg);
+int pac_cancel(struct pac *pac, unsigned long handle);
 int pac_find_proxy_sync(char *js, char *url, char *host, char **proxy);
+int pac_find_proxy_blocking(struct pac *pac, char *url, char *host,
+                            char **proxy);
 void pac_run_callbacks(struct pac *pac);
+void pac_get_stats(struct pac *pac, struct pac_stats *stats);
+void pac_network_changed(void);
 
 #define PAC_LOGLVL_DEBUG 0x00
 #define PAC_LOGLVL_INFO  0x01
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "phash.h"
+
+struct key {
+    char *s;
+    size_t len;
+    int value;
+    unsigned long long hash;
+};
+
+struct phash {
+    struct key *keys;    /* Until built; then the table, one per slot. */
+    int n_keys;
+    unsigned int *disp;  /* Displacement of each bucket. */
+    int n_buckets;
+    unsigned long long seed;
+};
+
+/* Keys per bucket, on average. */
+#define BUCKET_KEYS 3
+/* Tries for a bucket, and for a seed, before starting over. */
+#define MAX_DISP 65536
+#define MAX_SEEDS 64
+#define GOLDEN 0x9e3779b97f4a7c15ull
+
+static unsigned long long mix(unsigned long long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static unsigned long long hash(unsigned long long seed, const char *s,
+                               size_t len)
+{
+    unsigned long long h = 14695981039346656037ull ^ seed;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+
+    return mix(h);
+}
+
+static int bucket(const struct phash *phash, unsigned long long h)
+{
+    return (h >> 32) % phash->n_buckets;
+}
+
+static int slot(const struct phash *phash, unsigned long long h,
+                unsigned int disp)
+{
+    return mix(h + disp * GOLDEN) % phash->n_keys;
+}
+
+static void free_keys(struct key *keys, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        free(keys[i].s);
+    free(keys);
+}
+
+struct phash *phash_create(void)
+{
+    return calloc(1, sizeof(struct phash));
+}
+
+void phash_free(struct phash *phash)
+{
+    if (!phash)
+        return;
+
+    free_keys(phash->keys, phash->n_keys);
+    free(phash->disp);
+    free(phash);
+}
+
+int phash_add(struct phash *phash, const char *s, size_t len, int value)
+{
+    struct key *k;
+
+    /* Powers of two. */
+    if (!(phash->n_keys & (phash->n_keys - 1))) {
+        k = realloc(phash->keys, (phash->n_keys ? 2 * phash->n_keys : 1) *
+                                     sizeof(struct key));
+        if (!k)
+            return -1;
+        phash->keys = k;
+    }
+
+    k = &phash->keys[phash->n_keys];
+    k->s = malloc(len + 1);
+    if (!k->s)
+        return -1;
+    memcpy(k->s, s, len);
+    k->len = len;
+    k->value = value;
+    phash->n_keys++;
+
+    return 0;
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+    const struct key *x = a, *y = b;
+    int c;
+
+    if (x->len != y->len)
+        return x->len < y->len ? -1 : 1;
+    c = memcmp(x->s, y->s, x->len);
+    if (c)
+        return c;
+    return x->value - y->value;
+}
+
+/* Drop repeated strings, which no displacement could tell apart. */
+static void unique_keys(struct phash *phash)
+{
+    struct key *keys = phash->keys;
+    int i, n = 0;
+
+    qsort(keys, phash->n_keys, sizeof(struct key), compare_keys);
+    for (i = 0; i < phash->n_keys; i++) {
+        if (n && keys[i].len == keys[n - 1].len &&
+            !memcmp(keys[i].s, keys[n - 1].s, keys[i].len)) {
+            /* Sorted by value too, so the first one has the lowest. */
+            free(keys[i].s);
+            continue;
+        }
+        keys[n++] = keys[i];
+    }
+    phash->n_keys = n;
+}
+
+/*
+ * Try to place all keys with the current seed, largest buckets first,
+ * while there is most room. The arrays are scratch space.
+ */
+static int place(struct phash *phash, int *order, int *first,
+                 unsigned char *taken, int *slots)
+{
+    int n = phash->n_keys, nb = phash->n_buckets, i, j, b, size, s, ok;
+    int max_size = 0;
+    unsigned int d;
+
+    /* Keys by bucket: first[b] .. first[b + 1] in order. */
+    memset(first, 0, (nb + 1) * sizeof(int));
+    for (i = 0; i < n; i++) {
+        phash->keys[i].hash = hash(phash->seed, phash->keys[i].s,
+                                   phash->keys[i].len);
+        first[bucket(phash, phash->keys[i].hash) + 1]++;
+    }
+    for (b = 0; b < nb; b++)
+        first[b + 1] += first[b];
+    for (i = 0; i < n; i++)
+        order[first[bucket(phash, phash->keys[i].hash)]++] = i;
+    for (b = nb; b > 0; b--)
+        first[b] = first[b - 1];
+    first[0] = 0;
+    for (b = 0; b < nb; b++)
+        if (first[b + 1] - first[b] > max_size)
+            max_size = first[b + 1] - first[b];
+
+    memset(taken, 0, n);
+    for (size = max_size; size > 0; size--) {
+        for (b = 0; b < nb; b++) {
+            if (first[b + 1] - first[b] != size)
+                continue;
+            for (d = 0; d < MAX_DISP; d++) {
+                ok = 1;
+                for (j = 0; ok && j < size; j++) {
+                    s = slot(phash, phash->keys[order[first[b] + j]].hash, d);
+                    if (taken[s])
+                        ok = 0;
+                    else
+                        taken[slots[j] = s] = 1;
+                }
+                if (ok)
+                    break;
+                /* Give back the slots of this try. */
+                while (--j > 0)
+                    taken[slots[j - 1]] = 0;
+            }
+            if (d == MAX_DISP)
+                return -1;
+            phash->disp[b] = d;
+        }
+    }
+
+    return 0;
+}
+
+int phash_build(struct phash *phash)
+{
+    int *order = NULL, *first = NULL, *slots = NULL, i, n, ret = -1;
+    unsigned char *taken = NULL;
+    struct key *table = NULL;
+
+    unique_keys(phash);
+    n = phash->n_keys;
+    if (!n)
+        return 0;
+
+    phash->n_buckets = (n + BUCKET_KEYS - 1) / BUCKET_KEYS;
+    free(phash->disp);
+    phash->disp = malloc(phash->n_buckets * sizeof(unsigned int));
+    order = malloc(n * sizeof(int));
+    first = malloc((phash->n_buckets + 1) * sizeof(int));
+    slots = malloc(n * sizeof(int));
+    taken = malloc(n);
+    table = malloc(n * sizeof(struct key));
+    if (!phash->disp || !order || !first || !slots || !taken || !table)
+        goto out;
+
+    for (phash->seed = 0; phash->seed < MAX_SEEDS; phash->seed++)
+        if (place(phash, order, first, taken, slots) == 0)
+            break;
+    if (phash->seed == MAX_SEEDS)
+        goto out;
+
+    for (i = 0; i < n; i++) {
+        struct key *k = &phash->keys[i];
+        table[slot(phash, k->hash, phash->disp[bucket(phash, k->hash)])] = *k;
+    }
+    free(phash->keys);
+    phash->keys = table;
+    table = NULL;
+    ret = 0;
+
+out:
+    if (ret < 0) {
+        free(phash->disp);
+        phash->disp = NULL;
+    }
+    free(order);
+    free(first);
+    free(slots);
+    free(taken);
+    free(table);
+    return ret;
+}
+
+int phash_match(const struct phash *phash, const char *s, size_t len)
+{
+    unsigned long long h;
+    const struct key *k;
+
+    if (!phash->n_keys || !phash->disp)
+        return -1;
+
+    h = hash(phash->seed, s, len);
+    k = &phash->keys[slot(phash, h, phash->disp[bucket(phash, h)])];
+    if (k->len != len || memcmp(k->s, s, len))
+        return -1;
+
+    return k->value;
+}
@@ -0,0 +1,22 @@
+/*
+ * Minimal perfect hash over a fixed set of strings ("hash and displace"):
+ * the keys are spread over small buckets, and each bucket gets the
+ * displacement that sends all its keys to free slots of a table exactly
+ * as large as the set. A lookup is one hash of the string, and one compare
+ * against the only key it can be.
+ */
+struct phash;
+
+struct phash *phash_create(void);
+void phash_free(struct phash *phash);
+
+/*
+ * Add a string with a value, e.g. the index of the rule it comes from.
+ * Adding the same string again keeps the lower value. All strings must be
+ * added before phash_build().
+ */
+int phash_add(struct phash *phash, const char *s, size_t len, int value);
+int phash_build(struct phash *phash);
+
+/* Value of s, or -1 if it isn't in the set. */
+int phash_match(const struct phash *phash, const char *s, size_t len);
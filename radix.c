@@ -0,0 +1,257 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "radix.h"
+
+struct node {
+    unsigned char key[16]; /* Zero past the first bits. */
+    int bits;
+    int value;             /* -1 if no network ends here. */
+    struct node *child[2];
+};
+
+struct radix {
+    struct node *root;
+};
+
+static int bit(const unsigned char *addr, int i)
+{
+    return (addr[i / 8] >> (7 - i % 8)) & 1;
+}
+
+/* Number of leading bits, up to max, that a and b share. */
+static int common_bits(const unsigned char *a, const unsigned char *b,
+                       int max)
+{
+    int i, n = 0;
+    unsigned char diff;
+
+    for (i = 0; n < max; i++, n += 8) {
+        diff = a[i] ^ b[i];
+        if (diff) {
+            while (!(diff & 0x80)) {
+                diff <<= 1;
+                n++;
+            }
+            break;
+        }
+    }
+
+    return n < max ? n : max;
+}
+
+static struct node *new_node(const unsigned char *addr, int bits, int value)
+{
+    struct node *n = calloc(1, sizeof(struct node));
+    int i;
+
+    if (!n)
+        return NULL;
+
+    for (i = 0; i < bits / 8; i++)
+        n->key[i] = addr[i];
+    if (bits % 8)
+        n->key[i] = addr[i] & (0xff << (8 - bits % 8));
+    n->bits = bits;
+    n->value = value;
+
+    return n;
+}
+
+static void free_nodes(struct node *n)
+{
+    if (!n)
+        return;
+
+    free_nodes(n->child[0]);
+    free_nodes(n->child[1]);
+    free(n);
+}
+
+struct radix *radix_create(void)
+{
+    return calloc(1, sizeof(struct radix));
+}
+
+void radix_free(struct radix *radix)
+{
+    if (!radix)
+        return;
+
+    free_nodes(radix->root);
+    free(radix);
+}
+
+int radix_add(struct radix *radix, const unsigned char addr[16], int bits,
+              int value)
+{
+    struct node **slot = &radix->root, *n, *split, *leaf;
+    int common;
+
+    for (;;) {
+        n = *slot;
+        if (!n) {
+            *slot = new_node(addr, bits, value);
+            return *slot ? 0 : -1;
+        }
+
+        common = common_bits(n->key, addr, n->bits < bits ? n->bits : bits);
+        if (common < n->bits) {
+            /* Branch off where the keys part, above n. */
+            split = new_node(addr, common, common == bits ? value : -1);
+            leaf = common < bits ? new_node(addr, bits, value) : NULL;
+            if (!split || (common < bits && !leaf)) {
+                free(split);
+                free(leaf);
+                return -1;
+            }
+            split->child[bit(n->key, common)] = n;
+            if (leaf)
+                split->child[bit(addr, common)] = leaf;
+            *slot = split;
+            return 0;
+        }
+
+        if (n->bits == bits) {
+            if (n->value < 0 || value < n->value)
+                n->value = value;
+            return 0;
+        }
+        slot = &n->child[bit(addr, n->bits)];
+    }
+}
+
+int radix_match(const struct radix *radix, const unsigned char addr[16])
+{
+    const struct node *n = radix->root;
+    int best = -1;
+
+    while (n && common_bits(n->key, addr, n->bits) == n->bits) {
+        if (n->value >= 0 && (best < 0 || n->value < best))
+            best = n->value;
+        if (n->bits == 128)
+            break;
+        n = n->child[bit(addr, n->bits)];
+    }
+
+    return best;
+}
+
+void radix_map_ipv4(unsigned long ip, unsigned char addr[16])
+{
+    memset(addr, 0, 10);
+    addr[10] = addr[11] = 0xff;
+    addr[12] = ip >> 24;
+    addr[13] = ip >> 16;
+    addr[14] = ip >> 8;
+    addr[15] = ip;
+}
+
+static int parse_ipv4(const char *s, size_t len, unsigned long *ip)
+{
+    unsigned long a = 0, part;
+    int i, digits;
+
+    for (i = 0; i < 4; i++) {
+        part = 0;
+        for (digits = 0; len && isdigit((unsigned char)*s); digits++) {
+            part = part * 10 + (*s++ - '0');
+            len--;
+        }
+        if (digits < 1 || digits > 3 || part > 255)
+            return -1;
+        a = (a << 8) | part;
+        if (i < 3) {
+            if (!len || *s != '.')
+                return -1;
+            s++;
+            len--;
+        }
+    }
+    if (len)
+        return -1;
+
+    *ip = a;
+    return 0;
+}
+
+/* Groups of up to four hex digits, "::" once, and maybe a dotted quad. */
+static int parse_ipv6(const char *s, size_t len, unsigned char addr[16])
+{
+    const char *end = s + len, *p;
+    unsigned long ip, group;
+    int n = 0, gap = -1, digits;
+
+    memset(addr, 0, 16);
+    if (len >= 2 && s[0] == ':' && s[1] == ':') {
+        gap = 0;
+        s += 2;
+    }
+
+    while (s < end) {
+        for (p = s; p < end && *p != ':' && *p != '.'; p++)
+            ;
+        if (p < end && *p == '.') {
+            /* Trailing IPv4 address. */
+            if (n > 12 || parse_ipv4(s, end - s, &ip) < 0)
+                return -1;
+            addr[n++] = ip >> 24;
+            addr[n++] = ip >> 16;
+            addr[n++] = ip >> 8;
+            addr[n++] = ip;
+            s = end;
+            break;
+        }
+
+        group = 0;
+        for (digits = 0; s < p; s++, digits++) {
+            if (!isxdigit((unsigned char)*s))
+                return -1;
+            group = group * 16 +
+                    (isdigit((unsigned char)*s) ? *s - '0'
+                                                : tolower(*s) - 'a' + 10);
+        }
+        if (digits < 1 || digits > 4 || n > 14)
+            return -1;
+        addr[n++] = group >> 8;
+        addr[n++] = group;
+
+        if (s == end)
+            break;
+        s++; /* ':' */
+        if (s < end && *s == ':') {
+            if (gap >= 0)
+                return -1;
+            gap = n;
+            s++;
+        } else if (s == end) {
+            return -1;
+        }
+    }
+
+    if (gap >= 0) {
+        if (n == 16)
+            return -1;
+        memmove(addr + 16 - (n - gap), addr + gap, n - gap);
+        memset(addr + gap, 0, 16 - n);
+    } else if (n != 16) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int radix_parse(const char *s, size_t len, unsigned char addr[16])
+{
+    unsigned long ip;
+
+    if (parse_ipv4(s, len, &ip) == 0) {
+        radix_map_ipv4(ip, addr);
+        return 4;
+    }
+    if (parse_ipv6(s, len, addr) == 0)
+        return 6;
+
+    return -1;
+}
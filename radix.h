@@ -0,0 +1,29 @@
+/*
+ * Set of IP networks, as a path compressed binary trie (Patricia tree)
+ * over 128 bit addresses. IPv4 addresses are mapped into ::ffff:0:0/96,
+ * so both families share one tree. A lookup is one walk down the tree,
+ * visiting every network that contains the address.
+ */
+struct radix;
+
+struct radix *radix_create(void);
+void radix_free(struct radix *radix);
+
+/*
+ * Add the network of the first bits of addr, with a value, e.g. the index
+ * of the rule it comes from. Adding the same network again keeps the lower
+ * value.
+ */
+int radix_add(struct radix *radix, const unsigned char addr[16], int bits,
+              int value);
+
+/* Lowest value of the networks containing addr, or -1 if none. */
+int radix_match(const struct radix *radix, const unsigned char addr[16]);
+
+/*
+ * Parse an IPv4 (dotted quad) or IPv6 address. Returns 4 or 6 for the
+ * family, or -1 if s isn't an address.
+ */
+int radix_parse(const char *s, size_t len, unsigned char addr[16]);
+/* An IPv4 address, in host byte order, as mapped into the tree. */
+void radix_map_ipv4(unsigned long ip, unsigned char addr[16]);
@@ -0,0 +1,26 @@
+/*
+ * A PAC script built into the library with configure --with-rom-pac. It
+ * is compiled to bytecode by mkrom at build time, which then ends up in
+ * the read-only data of the library, so loading it doesn't parse the
+ * script, and all processes share its pages. Every context still loads
+ * a copy of the bytecode into its own heap.
+ */
+struct pac_rom {
+    const char *javascript;
+    const unsigned char *bytecode;
+    size_t bytecode_len;
+    /* Of the script rewritten by rules_compile(), or NULL if no rules. */
+    const unsigned char *rules_bytecode;
+    size_t rules_bytecode_len;
+};
+
+extern const struct pac_rom pac_rom;
+
+/*
+ * For mkrom: compile js to bytecode as pac_init_opts() would, with or
+ * without compile_rules. Returns 1 if compile_rules finds no rules, or -1
+ * if js doesn't evaluate; otherwise, *bytecode is set to a malloc()ed
+ * copy.
+ */
+int pac_compile_rom(char *js, int compile_rules, unsigned char **bytecode,
+                    size_t *len);
@@ -0,0 +1,1547 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aho.h"
+#include "bloom.h"
+#include "phash.h"
+#include "radix.h"
+#include "rules.h"
+#include "suffix.h"
+
+/* Extra parameter of the rewritten FindProxyForURL(). */
+#define SKIP_PARAM "__pac_skip_rules"
+
+/* Values a rule condition can take: host names need DNS for isInNet(). */
+#define FALSE 0
+#define TRUE 1
+#define UNKNOWN -1
+
+/* What helpers are applied to. */
+enum subject {
+    S_HOST,
+    S_LHOST, /* host.toLowerCase() */
+    S_URL,
+    S_LURL,  /* url.toLowerCase() */
+    N_SUBJECTS
+};
+
+enum kind {
+    A_DOMAIN_IS, /* dnsDomainIs(s, "lit"), shExpMatch(s, "*lit") */
+    A_SHEXP,     /* shExpMatch(s, "lit"), without alternatives */
+    A_IN_NET,    /* isInNet(s, "net", "mask") */
+    A_EQUALS,    /* s == "lit", localHostOrDomainIs(s, "lit") */
+    A_CONTAINS,  /* s.indexOf("lit") != -1 */
+    A_STARTS,    /* s.substring(0, n) == "lit" */
+    A_PLAIN,     /* isPlainHostName(s) */
+    A_MY_NET,    /* isInNet(myIpAddress(), "net", "mask") */
+    N_KINDS
+};
+
+struct atom {
+    int kind;
+    int subject;
+    int rule;
+    char *lit;
+    size_t len;
+    size_t n;                /* A_STARTS */
+    unsigned long net, mask; /* A_IN_NET, A_MY_NET */
+};
+
+enum { N_ATOM, N_NOT, N_AND, N_OR };
+
+struct node {
+    int type;
+    int left;  /* Atom for N_ATOM. */
+    int right;
+};
+
+struct rule {
+    int cond;     /* Root node. */
+    char *result;
+    int simple;   /* Just atoms joined by ||: found via the atom lists. */
+};
+
+/* Longest dnsDomainIs() suffix the filter takes. */
+#define MAX_SUFFIX_LEN 256
+
+#define FNV64_BASIS 14695981039346656037ull
+#define FNV64_PRIME 1099511628211ull
+
+struct atom_list {
+    int *atoms; /* In rule order. */
+    int n;
+    /* Indexes finding the first matching atom in one pass. */
+    struct suffix_trie *trie; /* For A_DOMAIN_IS. */
+    struct aho *aho;          /* For A_CONTAINS. */
+    struct radix *radix;      /* For A_IN_NET with prefix masks. */
+    struct phash *phash;      /* For A_EQUALS. */
+    int n_linear; /* Atoms not in an index, moved to the front. */
+};
+
+struct rules {
+    struct rule *rules;
+    int n_rules;
+    struct atom *atoms;
+    int n_atoms;
+    struct node *nodes;
+    int n_nodes;
+    /* Atoms of simple rules. */
+    struct atom_list lists[N_KINDS][N_SUBJECTS];
+    /* Rules that aren't simple, in order. */
+    int *complex;
+    int n_complex;
+    /*
+     * First simple rule checking whether host is in a network: it can only
+     * be decided natively if host is an IP address.
+     */
+    int first_in_net;
+    int uses[N_SUBJECTS];
+    int use_my_ip;
+    /*
+     * If all rules just compare the end or the whole of the host or URL to
+     * literals, a filter of these, which proves most misses without even
+     * looking at the indexes.
+     */
+    struct bloom *filter;
+    unsigned char suffix_lens[N_SUBJECTS][MAX_SUFFIX_LEN / 8];
+    size_t max_suffix[N_SUBJECTS]; /* Plus one, or 0 if none. */
+    int whole[N_SUBJECTS];
+    /* What FindProxyForURL() returns if no rule matches, if constant. */
+    char *fallback;
+};
+
+/*
+ * Lexer, for the little part of Javascript the rules are written in.
+ * Anything else ends the compiled part of the script.
+ */
+enum { T_END, T_IDENT, T_STRING, T_NUMBER, T_PUNCT, T_OTHER };
+
+struct lexer {
+    const char *p;     /* After the current token. */
+    int type;
+    const char *start; /* Of the token; for strings, of their content. */
+    size_t len;
+    const char *tok;   /* Of the token, including quotes. */
+    const char *prev;  /* End of the previous token. */
+};
+
+static const char *puncts[] = {
+    "===", "!==", "==", "!=", ">=", "<=", "||", "&&",
+    "(", ")", "{", "}", ";", ",", ".", "=", "!", "<", ">", "-", NULL
+};
+
+static int is_ident_char(int c)
+{
+    return isalnum(c) || c == '_' || c == '$';
+}
+
+static void skip_space(struct lexer *lx)
+{
+    for (;;) {
+        while (isspace((unsigned char)*lx->p))
+            lx->p++;
+        if (lx->p[0] == '/' && lx->p[1] == '/') {
+            while (*lx->p && *lx->p != '\n')
+                lx->p++;
+        } else if (lx->p[0] == '/' && lx->p[1] == '*') {
+            const char *end = strstr(lx->p + 2, "*/");
+            lx->p = end ? end + 2 : lx->p + strlen(lx->p);
+        } else {
+            return;
+        }
+    }
+}
+
+static void next(struct lexer *lx)
+{
+    const char *p;
+    int i;
+
+    lx->prev = lx->p;
+    skip_space(lx);
+    p = lx->tok = lx->start = lx->p;
+
+    if (!*p) {
+        lx->type = T_END;
+        lx->len = 0;
+        return;
+    }
+
+    if (isalpha((unsigned char)*p) || *p == '_' || *p == '$') {
+        while (is_ident_char((unsigned char)*p))
+            p++;
+        lx->type = T_IDENT;
+    } else if (isdigit((unsigned char)*p)) {
+        while (isdigit((unsigned char)*p))
+            p++;
+        lx->type = is_ident_char((unsigned char)*p) || *p == '.' ? T_OTHER
+                                                                 : T_NUMBER;
+    } else if (*p == '"' || *p == '\'') {
+        char quote = *p++;
+        lx->start = p;
+        /* No escapes: what you see is the value. */
+        while (*p && *p != quote && *p != '\\' && *p != '\n' &&
+               (unsigned char)*p < 0x80)
+            p++;
+        if (*p != quote) {
+            lx->type = T_OTHER;
+            lx->len = 0;
+            return;
+        }
+        lx->len = p - lx->start;
+        lx->p = p + 1;
+        lx->type = T_STRING;
+        return;
+    } else {
+        lx->type = T_OTHER;
+        for (i = 0; puncts[i]; i++) {
+            size_t n = strlen(puncts[i]);
+            if (!strncmp(p, puncts[i], n)) {
+                p += n;
+                lx->type = T_PUNCT;
+                break;
+            }
+        }
+        if (lx->type == T_OTHER)
+            p++;
+    }
+
+    lx->len = p - lx->start;
+    lx->p = p;
+}
+
+static int is(struct lexer *lx, int type, const char *s)
+{
+    return lx->type == type && strlen(s) == lx->len &&
+           !strncmp(lx->start, s, lx->len);
+}
+
+static int accept(struct lexer *lx, int type, const char *s)
+{
+    if (!is(lx, type, s))
+        return 0;
+    next(lx);
+    return 1;
+}
+
+#define MAX_VARS 16
+
+struct var {
+    const char *name;
+    size_t len;
+    int subject; /* -1 if not one. */
+};
+
+struct stmt {
+    const char *start, *end;
+    int is_rule;
+};
+
+struct parser {
+    struct lexer lx;
+    struct rules *r;
+    struct var vars[MAX_VARS];
+    int n_vars;
+    int failed; /* Out of memory. */
+};
+
+static void *grow(void *p, int n, size_t size)
+{
+    /* Powers of two. */
+    if (n & (n - 1))
+        return p;
+    return realloc(p, (n ? 2 * n : 1) * size);
+}
+
+static int add_node(struct parser *ps, int type, int left, int right)
+{
+    struct rules *r = ps->r;
+    struct node *nodes = grow(r->nodes, r->n_nodes, sizeof(struct node));
+
+    if (!nodes) {
+        ps->failed = 1;
+        return -1;
+    }
+    r->nodes = nodes;
+    nodes[r->n_nodes].type = type;
+    nodes[r->n_nodes].left = left;
+    nodes[r->n_nodes].right = right;
+
+    return r->n_nodes++;
+}
+
+static int add_atom(struct parser *ps, int kind, int subject,
+                    const char *lit, size_t len)
+{
+    struct rules *r = ps->r;
+    struct atom *atoms = grow(r->atoms, r->n_atoms, sizeof(struct atom));
+    struct atom *a;
+
+    if (!atoms) {
+        ps->failed = 1;
+        return -1;
+    }
+    r->atoms = atoms;
+    a = &atoms[r->n_atoms];
+    memset(a, 0, sizeof(*a));
+    a->kind = kind;
+    a->subject = subject;
+    a->rule = r->n_rules;
+    a->len = len;
+    a->lit = malloc(len + 1);
+    if (!a->lit) {
+        ps->failed = 1;
+        return -1;
+    }
+    memcpy(a->lit, lit, len);
+    a->lit[len] = '\0';
+    r->uses[subject] = 1;
+
+    return add_node(ps, N_ATOM, r->n_atoms++, -1);
+}
+
+/* The subject a variable name stands for, or -1. */
+static int subject_of(struct parser *ps)
+{
+    int i;
+
+    if (ps->lx.type != T_IDENT)
+        return -1;
+    for (i = 0; i < ps->n_vars; i++)
+        if (ps->vars[i].len == ps->lx.len &&
+            !strncmp(ps->vars[i].name, ps->lx.start, ps->lx.len))
+            return ps->vars[i].subject;
+
+    return -1;
+}
+
+static int subject_arg(struct parser *ps)
+{
+    int s = subject_of(ps);
+
+    if (s >= 0)
+        next(&ps->lx);
+    return s;
+}
+
+/* A dotted quad as isInNet() takes it, without surprises. */
+static int parse_ipv4(const char *s, size_t len, unsigned long *addr)
+{
+    unsigned long a = 0, part;
+    int i, digits;
+
+    for (i = 0; i < 4; i++) {
+        part = 0;
+        for (digits = 0; len && isdigit((unsigned char)*s); digits++) {
+            part = part * 10 + (*s++ - '0');
+            len--;
+        }
+        if (digits < 1 || digits > 3 || part > 255)
+            return -1;
+        a = (a << 8) | part;
+        if (i < 3) {
+            if (!len || *s != '.')
+                return -1;
+            s++;
+            len--;
+        }
+    }
+    if (len)
+        return -1;
+
+    *addr = a;
+    return 0;
+}
+
+/*
+ * shExpMatch() turns its pattern into a regular expression, only
+ * translating '.', '*' and '?'. Accept patterns where no other characters
+ * have a special meaning, except for a list of alternatives in parentheses.
+ */
+static int glob_ok(const char *p, size_t len)
+{
+    for (; len; p++, len--)
+        if (strchr("\\^$+()[]{}|", *p))
+            return 0;
+    return 1;
+}
+
+/* "*.example.com" is just dnsDomainIs(s, ".example.com"). */
+static int add_glob(struct parser *ps, int subject, const char *glob,
+                    size_t len)
+{
+    if (len && glob[0] == '*' && !memchr(glob + 1, '*', len - 1) &&
+        !memchr(glob + 1, '?', len - 1))
+        return add_atom(ps, A_DOMAIN_IS, subject, glob + 1, len - 1);
+
+    return add_atom(ps, A_SHEXP, subject, glob, len);
+}
+
+static int parse_shexp(struct parser *ps, int subject, const char *p,
+                       size_t len)
+{
+    const char *open, *close, *alt, *q;
+    size_t pre, post;
+    char *glob;
+    int node = -1, atom;
+
+    if (glob_ok(p, len))
+        return add_glob(ps, subject, p, len);
+
+    /* a(b|c)d: any of abd and acd. */
+    open = memchr(p, '(', len);
+    close = open ? memchr(open, ')', p + len - open) : NULL;
+    if (!close)
+        return -1;
+    pre = open - p;
+    post = p + len - close - 1;
+    if (!glob_ok(p, pre) || !glob_ok(close + 1, post))
+        return -1;
+
+    glob = malloc(len);
+    if (!glob) {
+        ps->failed = 1;
+        return -1;
+    }
+    memcpy(glob, p, pre);
+    for (alt = open + 1; alt <= close; alt = q + 1) {
+        for (q = alt; q < close && *q != '|'; q++)
+            ;
+        if (!glob_ok(alt, q - alt)) {
+            node = -1;
+            break;
+        }
+        memcpy(glob + pre, alt, q - alt);
+        memcpy(glob + pre + (q - alt), close + 1, post);
+        atom = add_glob(ps, subject, glob, pre + (q - alt) + post);
+        node = atom < 0 ? -1
+                        : node < 0 ? atom : add_node(ps, N_OR, node, atom);
+        if (node < 0)
+            break;
+    }
+    free(glob);
+
+    return node;
+}
+
+/* -1 or 0, as compared to the result of indexOf(). */
+static int parse_index(struct parser *ps)
+{
+    int neg = accept(&ps->lx, T_PUNCT, "-");
+
+    if (ps->lx.type != T_NUMBER || ps->lx.len != 1 ||
+        *ps->lx.start != (neg ? '1' : '0'))
+        return 1;
+    next(&ps->lx);
+    return neg ? -1 : 0;
+}
+
+/* A constant string argument. */
+static int string_arg(struct parser *ps, const char **s, size_t *len)
+{
+    if (ps->lx.type != T_STRING)
+        return -1;
+    *s = ps->lx.start;
+    *len = ps->lx.len;
+    next(&ps->lx);
+    return 0;
+}
+
+static int negate(struct parser *ps, int node, int neg)
+{
+    if (node < 0 || !neg)
+        return node;
+    return add_node(ps, N_NOT, node, -1);
+}
+
+/* s.indexOf("lit") compared to -1 or 0, or s.substring(0, n) == "lit". */
+static int parse_method(struct parser *ps, int subject)
+{
+    struct lexer *lx = &ps->lx;
+    const char *lit;
+    size_t len, n;
+    int node, neg;
+
+    if (accept(lx, T_IDENT, "indexOf")) {
+        if (!accept(lx, T_PUNCT, "(") || string_arg(ps, &lit, &len) < 0 ||
+            !accept(lx, T_PUNCT, ")"))
+            return -1;
+        if (accept(lx, T_PUNCT, "!=") || accept(lx, T_PUNCT, "!==") ||
+            accept(lx, T_PUNCT, ">"))
+            neg = parse_index(ps) == -1 ? 0 : 2;
+        else if (accept(lx, T_PUNCT, ">="))
+            neg = parse_index(ps) == 0 ? 0 : 2;
+        else if (accept(lx, T_PUNCT, "==") || accept(lx, T_PUNCT, "==="))
+            neg = parse_index(ps) == -1 ? 1 : 2;
+        else if (accept(lx, T_PUNCT, "<"))
+            neg = parse_index(ps) == 0 ? 1 : 2;
+        else
+            return -1;
+        if (neg > 1)
+            return -1;
+        node = add_atom(ps, A_CONTAINS, subject, lit, len);
+        return negate(ps, node, neg);
+    }
+
+    if (accept(lx, T_IDENT, "substring")) {
+        if (!accept(lx, T_PUNCT, "(") || parse_index(ps) != 0 ||
+            !accept(lx, T_PUNCT, ",") || lx->type != T_NUMBER ||
+            lx->len > 4)
+            return -1;
+        n = strtoul(lx->start, NULL, 10);
+        next(lx);
+        if (!accept(lx, T_PUNCT, ")"))
+            return -1;
+        if (accept(lx, T_PUNCT, "==") || accept(lx, T_PUNCT, "==="))
+            neg = 0;
+        else if (accept(lx, T_PUNCT, "!=") || accept(lx, T_PUNCT, "!=="))
+            neg = 1;
+        else
+            return -1;
+        if (string_arg(ps, &lit, &len) < 0)
+            return -1;
+        node = add_atom(ps, A_STARTS, subject, lit, len);
+        if (node >= 0)
+            ps->r->atoms[ps->r->n_atoms - 1].n = n;
+        return negate(ps, node, neg);
+    }
+
+    return -1;
+}
+
+static int parse_atom(struct parser *ps)
+{
+    struct lexer *lx = &ps->lx;
+    const char *lit, *mask, *dot;
+    size_t len, mask_len;
+    unsigned long net, netmask;
+    int subject, kind, node, right, neg;
+
+    /* "lit" == s */
+    if (lx->type == T_STRING) {
+        string_arg(ps, &lit, &len);
+        if (accept(lx, T_PUNCT, "==") || accept(lx, T_PUNCT, "==="))
+            neg = 0;
+        else if (accept(lx, T_PUNCT, "!=") || accept(lx, T_PUNCT, "!=="))
+            neg = 1;
+        else
+            return -1;
+        subject = subject_arg(ps);
+        if (subject < 0)
+            return -1;
+        return negate(ps, add_atom(ps, A_EQUALS, subject, lit, len), neg);
+    }
+
+    subject = subject_arg(ps);
+    if (subject >= 0) {
+        if (accept(lx, T_PUNCT, "."))
+            return parse_method(ps, subject);
+        if (accept(lx, T_PUNCT, "==") || accept(lx, T_PUNCT, "==="))
+            neg = 0;
+        else if (accept(lx, T_PUNCT, "!=") || accept(lx, T_PUNCT, "!=="))
+            neg = 1;
+        else
+            return -1;
+        if (string_arg(ps, &lit, &len) < 0)
+            return -1;
+        return negate(ps, add_atom(ps, A_EQUALS, subject, lit, len), neg);
+    }
+
+    if (accept(lx, T_IDENT, "isPlainHostName")) {
+        if (!accept(lx, T_PUNCT, "(") || (subject = subject_arg(ps)) < 0 ||
+            !accept(lx, T_PUNCT, ")"))
+            return -1;
+        return add_atom(ps, A_PLAIN, subject, "", 0);
+    }
+
+    /* The host name itself, or any of its leading labels. */
+    if (accept(lx, T_IDENT, "localHostOrDomainIs")) {
+        if (!accept(lx, T_PUNCT, "(") || (subject = subject_arg(ps)) < 0 ||
+            !accept(lx, T_PUNCT, ",") || string_arg(ps, &lit, &len) < 0 ||
+            !accept(lx, T_PUNCT, ")"))
+            return -1;
+        node = add_atom(ps, A_EQUALS, subject, lit, len);
+        for (dot = memchr(lit, '.', len); node >= 0 && dot;
+             dot = memchr(dot + 1, '.', lit + len - dot - 1)) {
+            right = add_atom(ps, A_EQUALS, subject, lit, dot - lit);
+            node = right < 0 ? -1 : add_node(ps, N_OR, node, right);
+        }
+        return node;
+    }
+
+    if (accept(lx, T_IDENT, "dnsDomainIs")) {
+        if (!accept(lx, T_PUNCT, "(") || (subject = subject_arg(ps)) < 0 ||
+            !accept(lx, T_PUNCT, ",") || string_arg(ps, &lit, &len) < 0 ||
+            !accept(lx, T_PUNCT, ")"))
+            return -1;
+        return add_atom(ps, A_DOMAIN_IS, subject, lit, len);
+    }
+
+    if (accept(lx, T_IDENT, "shExpMatch")) {
+        if (!accept(lx, T_PUNCT, "(") || (subject = subject_arg(ps)) < 0 ||
+            !accept(lx, T_PUNCT, ",") || string_arg(ps, &lit, &len) < 0 ||
+            !accept(lx, T_PUNCT, ")"))
+            return -1;
+        return parse_shexp(ps, subject, lit, len);
+    }
+
+    if (accept(lx, T_IDENT, "isInNet")) {
+        if (!accept(lx, T_PUNCT, "("))
+            return -1;
+        /* Not about the lookup: the subject is just a placeholder. */
+        if (accept(lx, T_IDENT, "myIpAddress")) {
+            if (!accept(lx, T_PUNCT, "(") || !accept(lx, T_PUNCT, ")"))
+                return -1;
+            kind = A_MY_NET;
+            subject = S_HOST;
+        } else {
+            kind = A_IN_NET;
+            subject = subject_arg(ps);
+        }
+        if (subject < 0 || (subject != S_HOST && subject != S_LHOST) ||
+            !accept(lx, T_PUNCT, ",") || string_arg(ps, &lit, &len) < 0 ||
+            !accept(lx, T_PUNCT, ",") ||
+            string_arg(ps, &mask, &mask_len) < 0 ||
+            !accept(lx, T_PUNCT, ")"))
+            return -1;
+        if (parse_ipv4(lit, len, &net) < 0 ||
+            parse_ipv4(mask, mask_len, &netmask) < 0)
+            return -1;
+        node = add_atom(ps, kind, subject, lit, len);
+        if (node >= 0) {
+            ps->r->atoms[ps->r->n_atoms - 1].net = net;
+            ps->r->atoms[ps->r->n_atoms - 1].mask = netmask;
+        }
+        return node;
+    }
+
+    return -1;
+}
+
+static int parse_or(struct parser *ps);
+
+/*
+ * Whether "!" applies to all of what follows: it binds tighter than "=="
+ * or ">=", so !host == "a" compares !host, which this can't express.
+ */
+static int negatable(struct lexer *lx)
+{
+    return is(lx, T_PUNCT, "!") || is(lx, T_PUNCT, "(") ||
+           is(lx, T_IDENT, "dnsDomainIs") || is(lx, T_IDENT, "shExpMatch") ||
+           is(lx, T_IDENT, "isInNet") || is(lx, T_IDENT, "isPlainHostName") ||
+           is(lx, T_IDENT, "localHostOrDomainIs");
+}
+
+static int parse_unary(struct parser *ps)
+{
+    int node;
+
+    if (accept(&ps->lx, T_PUNCT, "!"))
+        return negatable(&ps->lx) ? negate(ps, parse_unary(ps), 1) : -1;
+
+    if (accept(&ps->lx, T_PUNCT, "(")) {
+        node = parse_or(ps);
+        if (node < 0 || !accept(&ps->lx, T_PUNCT, ")"))
+            return -1;
+        return node;
+    }
+
+    return parse_atom(ps);
+}
+
+static int parse_and(struct parser *ps)
+{
+    int node = parse_unary(ps), right;
+
+    while (node >= 0 && accept(&ps->lx, T_PUNCT, "&&")) {
+        right = parse_unary(ps);
+        node = right < 0 ? -1 : add_node(ps, N_AND, node, right);
+    }
+
+    return node;
+}
+
+static int parse_or(struct parser *ps)
+{
+    int node = parse_and(ps), right;
+
+    while (node >= 0 && accept(&ps->lx, T_PUNCT, "||")) {
+        right = parse_and(ps);
+        node = right < 0 ? -1 : add_node(ps, N_OR, node, right);
+    }
+
+    return node;
+}
+
+/* Whether a name is a variable of FindProxyForURL() already. */
+static int is_var(struct parser *ps, const char *name, size_t len)
+{
+    int i;
+
+    for (i = 0; i < ps->n_vars; i++)
+        if (ps->vars[i].len == len && !strncmp(ps->vars[i].name, name, len))
+            return 1;
+    return 0;
+}
+
+/* var x; or var x = s.toLowerCase(); */
+static int parse_var(struct parser *ps)
+{
+    struct lexer *lx = &ps->lx;
+    struct var *v;
+    int subject;
+
+    if (!accept(lx, T_IDENT, "var") || lx->type != T_IDENT ||
+        is_var(ps, lx->start, lx->len) || ps->n_vars == MAX_VARS)
+        return -1;
+
+    v = &ps->vars[ps->n_vars];
+    v->name = lx->start;
+    v->len = lx->len;
+    v->subject = -1;
+    next(lx);
+
+    if (accept(lx, T_PUNCT, "=")) {
+        subject = subject_arg(ps);
+        if ((subject != S_HOST && subject != S_URL) ||
+            !accept(lx, T_PUNCT, ".") ||
+            !accept(lx, T_IDENT, "toLowerCase") ||
+            !accept(lx, T_PUNCT, "(") || !accept(lx, T_PUNCT, ")"))
+            return -1;
+        v->subject = subject == S_HOST ? S_LHOST : S_LURL;
+    }
+
+    if (!accept(lx, T_PUNCT, ";"))
+        return -1;
+
+    ps->n_vars++;
+    return 0;
+}
+
+/* if (cond) return "lit"; or the same with braces, but no else. */
+static int parse_rule(struct parser *ps)
+{
+    struct lexer *lx = &ps->lx;
+    struct rules *r = ps->r;
+    struct rule *rules;
+    const char *lit;
+    size_t len;
+    int cond, braces;
+
+    if (!accept(lx, T_IDENT, "if") || !accept(lx, T_PUNCT, "("))
+        return -1;
+    cond = parse_or(ps);
+    if (cond < 0 || !accept(lx, T_PUNCT, ")"))
+        return -1;
+    braces = accept(lx, T_PUNCT, "{");
+    if (!accept(lx, T_IDENT, "return") || string_arg(ps, &lit, &len) < 0 ||
+        !accept(lx, T_PUNCT, ";") || (braces && !accept(lx, T_PUNCT, "}")) ||
+        is(lx, T_IDENT, "else"))
+        return -1;
+
+    rules = grow(r->rules, r->n_rules, sizeof(struct rule));
+    if (!rules) {
+        ps->failed = 1;
+        return -1;
+    }
+    r->rules = rules;
+    rules[r->n_rules].cond = cond;
+    rules[r->n_rules].simple = 0;
+    rules[r->n_rules].result = malloc(len + 1);
+    if (!rules[r->n_rules].result) {
+        ps->failed = 1;
+        return -1;
+    }
+    memcpy(rules[r->n_rules].result, lit, len);
+    rules[r->n_rules].result[len] = '\0';
+    r->n_rules++;
+
+    return 0;
+}
+
+/* Occurrences of name as a whole word in js. */
+static int count_word(const char *js, const char *name, const char **last)
+{
+    size_t len = strlen(name);
+    const char *p;
+    int n = 0;
+
+    for (p = strstr(js, name); p; p = strstr(p + len, name)) {
+        if ((p > js && is_ident_char((unsigned char)p[-1])) ||
+            is_ident_char((unsigned char)p[len]))
+            continue;
+        if (last)
+            *last = p;
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * Whether name is used in js other than by calling it, which might
+ * redefine it (including as a property of the global object).
+ */
+static int redefined(const char *js, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p, *q;
+
+    for (p = strstr(js, name); p; p = strstr(p + len, name)) {
+        if ((p > js && is_ident_char((unsigned char)p[-1])) ||
+            is_ident_char((unsigned char)p[len]))
+            continue;
+        for (q = p + len; isspace((unsigned char)*q); q++)
+            ;
+        if (*q != '(')
+            return 1;
+        for (q = p; q > js && isspace((unsigned char)q[-1]); q--)
+            ;
+        if (q > js && q[-1] == '.')
+            return 1;
+        if (q - js >= 8 && !strncmp(q - 8, "function", 8))
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Names which, if used or redefined, might make the script behave
+ * differently from what the rules assume.
+ */
+static const char *unsafe_words[] = {
+    "eval", "arguments", "prototype", "__proto__", "defineProperty",
+    SKIP_PARAM, NULL
+};
+
+static const char *helpers[] = {
+    "dnsDomainIs", "shExpMatch", "isInNet", "isPlainHostName",
+    "localHostOrDomainIs", "convert_addr", "dnsResolve", "myIpAddress", NULL
+};
+
+static int script_ok(const char *js)
+{
+    int i;
+
+    if (count_word(js, "FindProxyForURL", NULL) != 1)
+        return 0;
+    for (i = 0; unsafe_words[i]; i++)
+        if (count_word(js, unsafe_words[i], NULL))
+            return 0;
+    for (i = 0; helpers[i]; i++)
+        if (redefined(js, helpers[i]))
+            return 0;
+
+    return 1;
+}
+
+/* Sort the atoms of simple rules into lists, by kind and subject. */
+static int is_simple(const struct rules *r, int node)
+{
+    const struct node *n = &r->nodes[node];
+
+    /* Those not about the lookup don't go into the lists either. */
+    if (n->type == N_ATOM)
+        return r->atoms[n->left].kind != A_MY_NET;
+    if (n->type != N_OR)
+        return 0;
+    return is_simple(r, n->left) && is_simple(r, n->right);
+}
+
+/* Length of mask as a network prefix, or -1 if it isn't one. */
+static int prefix_len(unsigned long mask)
+{
+    int n = 0;
+
+    while (n < 32 && (mask & (0x80000000ul >> n)))
+        n++;
+    if (mask & (0xfffffffful >> n))
+        return -1;
+
+    return n;
+}
+
+static int build_index(const struct rules *r, struct atom_list *l, int kind)
+{
+    const struct atom *a;
+    unsigned char addr[16];
+    int i, bits;
+
+    l->n_linear = 0;
+
+    switch (kind) {
+    case A_DOMAIN_IS:
+        l->trie = suffix_trie_create();
+        if (!l->trie)
+            return -1;
+        for (i = 0; i < l->n; i++) {
+            a = &r->atoms[l->atoms[i]];
+            if (suffix_trie_add(l->trie, a->lit, a->len, a->rule) < 0)
+                return -1;
+        }
+        break;
+    case A_CONTAINS:
+        l->aho = aho_create(0);
+        if (!l->aho)
+            return -1;
+        for (i = 0; i < l->n; i++) {
+            a = &r->atoms[l->atoms[i]];
+            if (aho_add(l->aho, a->lit, a->len, a->rule) < 0)
+                return -1;
+        }
+        return aho_build(l->aho);
+    case A_IN_NET:
+        l->radix = radix_create();
+        if (!l->radix)
+            return -1;
+        for (i = 0; i < l->n; i++) {
+            a = &r->atoms[l->atoms[i]];
+            bits = prefix_len(a->mask);
+            if (bits < 0) {
+                l->atoms[l->n_linear++] = l->atoms[i];
+                continue;
+            }
+            radix_map_ipv4(a->net & a->mask, addr);
+            if (radix_add(l->radix, addr, 96 + bits, a->rule) < 0)
+                return -1;
+        }
+        break;
+    case A_EQUALS:
+        l->phash = phash_create();
+        if (!l->phash)
+            return -1;
+        for (i = 0; i < l->n; i++) {
+            a = &r->atoms[l->atoms[i]];
+            if (phash_add(l->phash, a->lit, a->len, a->rule) < 0)
+                return -1;
+        }
+        return phash_build(l->phash);
+    default:
+        l->n_linear = l->n;
+    }
+
+    return 0;
+}
+
+/*
+ * Key of the filter for the hash h of a string, from its end, compared
+ * to a subject by an atom of some kind.
+ */
+static unsigned long long filter_key(unsigned long long h, int kind,
+                                     int subject)
+{
+    h ^= (unsigned long long)(kind * N_SUBJECTS + subject + 1) << 56;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static unsigned long long hash_back(const char *s, size_t len)
+{
+    unsigned long long h = FNV64_BASIS;
+
+    while (len)
+        h = (h ^ (unsigned char)s[--len]) * FNV64_PRIME;
+
+    return h;
+}
+
+static int build_filter(struct rules *r)
+{
+    const struct atom *a;
+    int i;
+
+    if (r->n_complex)
+        return 0;
+    for (i = 0; i < r->n_atoms; i++) {
+        a = &r->atoms[i];
+        if ((a->kind != A_DOMAIN_IS && a->kind != A_EQUALS) ||
+            (a->kind == A_DOMAIN_IS && a->len >= MAX_SUFFIX_LEN))
+            return 0;
+    }
+
+    r->filter = bloom_create(r->n_atoms);
+    if (!r->filter)
+        return -1;
+    for (i = 0; i < r->n_atoms; i++) {
+        a = &r->atoms[i];
+        bloom_add(r->filter, filter_key(hash_back(a->lit, a->len), a->kind,
+                                        a->subject));
+        if (a->kind == A_EQUALS) {
+            r->whole[a->subject] = 1;
+        } else {
+            r->suffix_lens[a->subject][a->len / 8] |= 1 << (a->len % 8);
+            if (a->len + 1 > r->max_suffix[a->subject])
+                r->max_suffix[a->subject] = a->len + 1;
+        }
+    }
+
+    return 0;
+}
+
+static int index_rules(struct rules *r)
+{
+    struct atom_list *l;
+    struct atom *a;
+    int *atoms, i, j;
+
+    r->first_in_net = r->n_rules;
+
+    for (i = 0; i < r->n_rules; i++)
+        r->rules[i].simple = is_simple(r, r->rules[i].cond);
+
+    r->complex = malloc((r->n_rules + 1) * sizeof(int));
+    if (!r->complex)
+        return -1;
+    for (i = 0; i < r->n_rules; i++)
+        if (!r->rules[i].simple)
+            r->complex[r->n_complex++] = i;
+
+    for (i = 0; i < r->n_atoms; i++) {
+        a = &r->atoms[i];
+        if (a->kind == A_MY_NET)
+            r->use_my_ip = 1;
+        if (!r->rules[a->rule].simple)
+            continue;
+        l = &r->lists[a->kind][a->subject];
+        atoms = grow(l->atoms, l->n, sizeof(int));
+        if (!atoms)
+            return -1;
+        l->atoms = atoms;
+        l->atoms[l->n++] = i;
+        if (a->kind == A_IN_NET && a->rule < r->first_in_net)
+            r->first_in_net = a->rule;
+    }
+
+    for (i = 0; i < N_KINDS; i++)
+        for (j = 0; j < N_SUBJECTS; j++)
+            if (r->lists[i][j].n && build_index(r, &r->lists[i][j], i) < 0)
+                return -1;
+
+    return build_filter(r);
+}
+
+/*
+ * The rewritten script: the compiled rules of FindProxyForURL() go into
+ * a block that the extra parameter skips. The variables declared among
+ * them are initialized before that block; their initializers have no side
+ * effects, and nothing assigns to their inputs in between.
+ */
+static char *rewrite(const char *js, const char *params_end,
+                     const struct stmt *stmts, int n_stmts)
+{
+    const char *start = stmts[0].start, *end = stmts[n_stmts - 1].end, *p;
+    size_t len = strlen(js) + strlen(SKIP_PARAM) * 2 + 32;
+    char *out = malloc(len + 2 * (end - start)), *o;
+    int i;
+
+    if (!out)
+        return NULL;
+
+    o = out;
+    memcpy(o, js, params_end - js);
+    o += params_end - js;
+    o += sprintf(o, ", %s", SKIP_PARAM);
+    memcpy(o, params_end, start - params_end);
+    o += start - params_end;
+
+    for (i = 0; i < n_stmts; i++) {
+        if (stmts[i].is_rule)
+            continue;
+        for (p = stmts[i].start; p < stmts[i].end; p++)
+            *o++ = *p == '\n' ? ' ' : *p;
+        *o++ = ' ';
+    }
+    o += sprintf(o, "if (!%s) {", SKIP_PARAM);
+
+    for (i = 0; i < n_stmts; i++) {
+        /* Between statements: comments and white space. */
+        p = i ? stmts[i - 1].end : start;
+        memcpy(o, p, stmts[i].start - p);
+        o += stmts[i].start - p;
+        if (stmts[i].is_rule) {
+            memcpy(o, stmts[i].start, stmts[i].end - stmts[i].start);
+            o += stmts[i].end - stmts[i].start;
+        } else {
+            for (p = stmts[i].start; p < stmts[i].end; p++)
+                *o++ = *p == '\n' ? '\n' : ' ';
+        }
+    }
+
+    *o++ = '}';
+    strcpy(o, end);
+
+    return out;
+}
+
+struct rules *rules_compile(const char *js, char **rewritten)
+{
+    struct parser ps;
+    struct lexer *lx = &ps.lx;
+    struct stmt *stmts = NULL, *s;
+    const char *fn, *params_end, *start, *lit;
+    size_t len;
+    int n_stmts = 0, n_rule_stmts = 0;
+
+    *rewritten = NULL;
+
+    if (!script_ok(js))
+        return NULL;
+
+    memset(&ps, 0, sizeof(ps));
+    ps.r = calloc(1, sizeof(struct rules));
+    if (!ps.r)
+        return NULL;
+
+    /* function FindProxyForURL(url, host) { */
+    count_word(js, "FindProxyForURL", &fn);
+    for (start = fn; start > js && isspace((unsigned char)start[-1]); start--)
+        ;
+    if (start - js < 8 || strncmp(start - 8, "function", 8))
+        goto fail;
+    lx->p = fn;
+    next(lx);
+    next(lx);
+    if (!accept(lx, T_PUNCT, "(") || lx->type != T_IDENT)
+        goto fail;
+    ps.vars[0].name = lx->start;
+    ps.vars[0].len = lx->len;
+    ps.vars[0].subject = S_URL;
+    next(lx);
+    if (!accept(lx, T_PUNCT, ",") || lx->type != T_IDENT ||
+        is_var(&ps, lx->start, lx->len))
+        goto fail;
+    ps.vars[1].name = lx->start;
+    ps.vars[1].len = lx->len;
+    ps.vars[1].subject = S_HOST;
+    ps.n_vars = 2;
+    next(lx);
+    if (!is(lx, T_PUNCT, ")"))
+        goto fail;
+    params_end = lx->tok;
+    next(lx);
+    if (!is(lx, T_PUNCT, "{"))
+        goto fail;
+    next(lx);
+
+    /* The statements that can be compiled, up to the last rule. */
+    for (;;) {
+        int n_vars = ps.n_vars, n_nodes = ps.r->n_nodes;
+        int n_atoms = ps.r->n_atoms;
+        struct lexer saved = *lx;
+
+        s = grow(stmts, n_stmts, sizeof(struct stmt));
+        if (!s)
+            goto fail;
+        stmts = s;
+        s = &stmts[n_stmts];
+        s->start = lx->tok;
+        if (is(lx, T_IDENT, "var")) {
+            s->is_rule = 0;
+            if (parse_var(&ps) < 0) {
+                ps.n_vars = n_vars;
+                *lx = saved;
+                break;
+            }
+        } else {
+            s->is_rule = 1;
+            if (parse_rule(&ps) < 0) {
+                /* Drop what the failed statement added. */
+                while (ps.r->n_atoms > n_atoms)
+                    free(ps.r->atoms[--ps.r->n_atoms].lit);
+                ps.r->n_nodes = n_nodes;
+                *lx = saved;
+                break;
+            }
+            n_rule_stmts = n_stmts + 1;
+        }
+        s->end = lx->prev;
+        n_stmts++;
+    }
+
+    if (ps.failed || !ps.r->n_rules)
+        goto fail;
+    /* If the function then returns a constant, so do misses. */
+    if (accept(lx, T_IDENT, "return") && string_arg(&ps, &lit, &len) == 0) {
+        accept(lx, T_PUNCT, ";");
+        if (is(lx, T_PUNCT, "}")) {
+            ps.r->fallback = malloc(len + 1);
+            if (!ps.r->fallback)
+                goto fail;
+            memcpy(ps.r->fallback, lit, len);
+            ps.r->fallback[len] = '\0';
+        }
+    }
+    /* Whatever the failed statement used is unused again. */
+    memset(ps.r->uses, 0, sizeof(ps.r->uses));
+    {
+        int i;
+        for (i = 0; i < ps.r->n_atoms; i++)
+            ps.r->uses[ps.r->atoms[i].subject] = 1;
+    }
+
+    if (index_rules(ps.r) < 0)
+        goto fail;
+
+    *rewritten = rewrite(js, params_end, stmts, n_rule_stmts);
+    if (!*rewritten)
+        goto fail;
+
+    free(stmts);
+    return ps.r;
+
+fail:
+    free(stmts);
+    rules_free(ps.r);
+    return NULL;
+}
+
+void rules_free(struct rules *r)
+{
+    int i, j;
+
+    if (!r)
+        return;
+
+    for (i = 0; i < r->n_rules; i++)
+        free(r->rules[i].result);
+    for (i = 0; i < r->n_atoms; i++)
+        free(r->atoms[i].lit);
+    for (i = 0; i < N_KINDS; i++)
+        for (j = 0; j < N_SUBJECTS; j++) {
+            free(r->lists[i][j].atoms);
+            suffix_trie_free(r->lists[i][j].trie);
+            aho_free(r->lists[i][j].aho);
+            radix_free(r->lists[i][j].radix);
+            phash_free(r->lists[i][j].phash);
+        }
+    free(r->rules);
+    free(r->atoms);
+    free(r->nodes);
+    free(r->complex);
+    bloom_free(r->filter);
+    free(r->fallback);
+    free(r);
+}
+
+/* What the rules are applied to in one lookup. */
+struct subjects {
+    const char *s[N_SUBJECTS];
+    size_t len[N_SUBJECTS];
+    int ip_state; /* TRUE if host is an IP address, FALSE if one out of
+                     range, UNKNOWN if a name. */
+    unsigned long ip;
+    int my_ip_state; /* Likewise, for myIpAddress(). */
+    unsigned long my_ip;
+};
+
+/* As the regular expression in isInNet() sees it. */
+static int host_ip(const char *host, unsigned long *ip)
+{
+    unsigned long a = 0, part;
+    int i, digits, in_range = 1;
+
+    for (i = 0; i < 4; i++) {
+        part = 0;
+        for (digits = 0; isdigit((unsigned char)*host); digits++)
+            part = part * 10 + (*host++ - '0');
+        if (digits < 1 || digits > 3)
+            return UNKNOWN;
+        if (part > 255)
+            in_range = 0;
+        a = (a << 8) | part;
+        if (i < 3 && *host++ != '.')
+            return UNKNOWN;
+    }
+    if (*host)
+        return UNKNOWN;
+
+    *ip = a;
+    return in_range ? TRUE : FALSE;
+}
+
+/* The regular expression shExpMatch() builds, without line terminators. */
+static int glob_match(const char *p, const char *s)
+{
+    const char *star = NULL, *retry = NULL;
+
+    while (*s) {
+        if (*p == '?' || (*p != '*' && *p == *s)) {
+            p++;
+            s++;
+        } else if (*p == '*') {
+            star = p++;
+            retry = s;
+        } else if (star) {
+            p = star + 1;
+            s = ++retry;
+        } else {
+            return 0;
+        }
+    }
+    while (*p == '*')
+        p++;
+
+    return !*p;
+}
+
+static int eval_atom(const struct atom *a, const struct subjects *sj)
+{
+    const char *s = sj->s[a->subject];
+    size_t len = sj->len[a->subject];
+
+    switch (a->kind) {
+    case A_DOMAIN_IS:
+        return len >= a->len && !memcmp(s + len - a->len, a->lit, a->len);
+    case A_SHEXP:
+        return glob_match(a->lit, s);
+    case A_IN_NET:
+        if (sj->ip_state != TRUE)
+            return sj->ip_state;
+        return (sj->ip & a->mask) == (a->net & a->mask);
+    case A_MY_NET:
+        if (sj->my_ip_state != TRUE)
+            return sj->my_ip_state;
+        return (sj->my_ip & a->mask) == (a->net & a->mask);
+    case A_EQUALS:
+        return len == a->len && !memcmp(s, a->lit, len);
+    case A_CONTAINS:
+        return strstr(s, a->lit) != NULL;
+    case A_STARTS:
+        return (len < a->n ? len : a->n) == a->len &&
+               !memcmp(s, a->lit, a->len);
+    case A_PLAIN:
+        return memchr(s, '.', len) == NULL;
+    }
+
+    return UNKNOWN;
+}
+
+static int eval_node(const struct rules *r, int node,
+                     const struct subjects *sj)
+{
+    const struct node *n = &r->nodes[node];
+    int left, right;
+
+    switch (n->type) {
+    case N_ATOM:
+        return eval_atom(&r->atoms[n->left], sj);
+    case N_NOT:
+        left = eval_node(r, n->left, sj);
+        return left == UNKNOWN ? UNKNOWN : !left;
+    case N_AND:
+        left = eval_node(r, n->left, sj);
+        if (left == FALSE)
+            return FALSE;
+        right = eval_node(r, n->right, sj);
+        if (right == FALSE)
+            return FALSE;
+        return left == TRUE && right == TRUE ? TRUE : UNKNOWN;
+    case N_OR:
+        left = eval_node(r, n->left, sj);
+        if (left == TRUE)
+            return TRUE;
+        right = eval_node(r, n->right, sj);
+        if (right == TRUE)
+            return TRUE;
+        return left == FALSE && right == FALSE ? FALSE : UNKNOWN;
+    }
+
+    return UNKNOWN;
+}
+
+/*
+ * First simple rule before limit with a matching atom of the given kind
+ * and subject, or limit.
+ */
+static int first_match(const struct rules *r, int kind, int subject,
+                       const struct subjects *sj, int limit)
+{
+    const struct atom_list *l = &r->lists[kind][subject];
+    const struct atom *a;
+    unsigned char addr[16];
+    int i = -1;
+
+    if (l->trie) {
+        i = suffix_trie_match(l->trie, sj->s[subject], sj->len[subject]);
+    } else if (l->aho) {
+        i = aho_match(l->aho, sj->s[subject], sj->len[subject]);
+    } else if (l->radix && sj->ip_state == TRUE) {
+        radix_map_ipv4(sj->ip, addr);
+        i = radix_match(l->radix, addr);
+    } else if (l->phash) {
+        i = phash_match(l->phash, sj->s[subject], sj->len[subject]);
+    }
+    if (i >= 0 && i < limit)
+        limit = i;
+
+    for (i = 0; i < l->n_linear; i++) {
+        a = &r->atoms[l->atoms[i]];
+        if (a->rule >= limit)
+            break;
+        if (eval_atom(a, sj) == TRUE)
+            return a->rule;
+    }
+
+    return limit;
+}
+
+static char *lower(const char *s, size_t len, char *buf, size_t buf_len)
+{
+    char *l = len < buf_len ? buf : malloc(len + 1);
+    size_t i;
+
+    if (!l)
+        return NULL;
+    for (i = 0; i < len; i++)
+        l[i] = tolower((unsigned char)s[i]);
+    l[len] = '\0';
+
+    return l;
+}
+
+/* Whether s is made of characters the rules see the way Javascript does. */
+static int plain_ascii(const char *s)
+{
+    for (; *s; s++)
+        if ((unsigned char)*s >= 0x80 || *s == '\n' || *s == '\r')
+            return 0;
+    return 1;
+}
+
+/* Whether the filter proves that no rule matches. */
+static int filter_miss(const struct rules *r, const struct subjects *sj)
+{
+    unsigned long long h;
+    const char *s;
+    size_t len, n, i;
+    int subject, c;
+
+    for (subject = 0; subject < N_SUBJECTS; subject++) {
+        if (!r->max_suffix[subject] && !r->whole[subject])
+            continue;
+        /* Lowercase versions are lowered on the fly. */
+        s = sj->s[subject == S_LHOST ? S_HOST
+                  : subject == S_LURL ? S_URL : subject];
+        len = sj->len[subject];
+        n = r->whole[subject] || len < r->max_suffix[subject]
+                ? len
+                : r->max_suffix[subject] - 1;
+
+        /* The suffixes of the lengths in the filter, then the whole. */
+        h = FNV64_BASIS;
+        for (i = 0;; i++) {
+            if (i < MAX_SUFFIX_LEN &&
+                (r->suffix_lens[subject][i / 8] & (1 << (i % 8))) &&
+                bloom_maybe(r->filter, filter_key(h, A_DOMAIN_IS, subject)))
+                return 0;
+            if (i == n)
+                break;
+            c = (unsigned char)s[len - 1 - i];
+            if (subject == S_LHOST || subject == S_LURL)
+                c = tolower(c);
+            h = (h ^ c) * FNV64_PRIME;
+        }
+        if (r->whole[subject] &&
+            bloom_maybe(r->filter, filter_key(h, A_EQUALS, subject)))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* No rule matches: the answer, if the script goes on to a constant. */
+static int miss(const struct rules *r, const char **result)
+{
+    if (!r->fallback)
+        return RULES_MISS;
+
+    *result = r->fallback;
+    return RULES_MATCH;
+}
+
+int rules_use_my_ip(const struct rules *r)
+{
+    return r->use_my_ip;
+}
+
+int rules_eval(const struct rules *r, const char *url, const char *host,
+               const char *my_ip, const char **result)
+{
+    char lhost_buf[256], lurl_buf[512];
+    struct subjects sj;
+    int found, barrier, kind, subject, i, c, ret = RULES_UNKNOWN;
+
+    if (!plain_ascii(host) || !plain_ascii(url))
+        return RULES_UNKNOWN;
+
+    memset(&sj, 0, sizeof(sj));
+    sj.s[S_HOST] = host;
+    sj.len[S_HOST] = strlen(host);
+    sj.s[S_URL] = url;
+    sj.len[S_URL] = strlen(url);
+    sj.len[S_LHOST] = sj.len[S_HOST];
+    sj.len[S_LURL] = sj.len[S_URL];
+    if (r->filter && filter_miss(r, &sj))
+        return miss(r, result);
+    if (r->uses[S_LHOST])
+        sj.s[S_LHOST] = lower(host, sj.len[S_HOST], lhost_buf,
+                              sizeof(lhost_buf));
+    if (r->uses[S_LURL])
+        sj.s[S_LURL] = lower(url, sj.len[S_URL], lurl_buf, sizeof(lurl_buf));
+    if ((r->uses[S_LHOST] && !sj.s[S_LHOST]) ||
+        (r->uses[S_LURL] && !sj.s[S_LURL]))
+        goto out;
+    sj.ip_state = host_ip(host, &sj.ip);
+    sj.my_ip_state = my_ip ? host_ip(my_ip, &sj.my_ip) : UNKNOWN;
+
+    /* The first simple rule that matches. */
+    found = r->n_rules;
+    for (kind = 0; kind < N_KINDS; kind++) {
+        if (kind == A_IN_NET && sj.ip_state == UNKNOWN)
+            continue;
+        for (subject = 0; subject < N_SUBJECTS; subject++)
+            found = first_match(r, kind, subject, &sj, found);
+    }
+
+    /* Unless an earlier one needs to resolve host. */
+    barrier = sj.ip_state == UNKNOWN ? r->first_in_net : r->n_rules;
+
+    /* Or an earlier one of the others matches, or can't be decided. */
+    for (i = 0; i < r->n_complex; i++) {
+        c = r->complex[i];
+        if (c >= found || c >= barrier)
+            break;
+        switch (eval_node(r, r->rules[c].cond, &sj)) {
+        case TRUE:
+            found = c;
+            break;
+        case UNKNOWN:
+            barrier = c;
+            break;
+        }
+    }
+
+    if (barrier < found) {
+        ret = RULES_UNKNOWN;
+    } else if (found < r->n_rules) {
+        *result = r->rules[found].result;
+        ret = RULES_MATCH;
+    } else {
+        ret = miss(r, result);
+    }
+
+out:
+    if (sj.s[S_LHOST] && sj.s[S_LHOST] != lhost_buf)
+        free((char *)sj.s[S_LHOST]);
+    if (sj.s[S_LURL] && sj.s[S_LURL] != lurl_buf)
+        free((char *)sj.s[S_LURL]);
+
+    return ret;
+}
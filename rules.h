@@ -0,0 +1,43 @@
+/*
+ * Compiler for the rules a PAC script starts FindProxyForURL() with:
+ * statements like
+ *
+ *     if (dnsDomainIs(host, ".example.com") || host == "a.example.org")
+ *         return "PROXY p:3128";
+ *
+ * whose conditions only apply built-in helpers with constant arguments to
+ * the host or URL, or don't depend on the lookup at all, like
+ * isInNet(myIpAddress(), "10.0.0.0", "255.0.0.0"). These are answered
+ * natively; the rest of the function still runs in the interpreter.
+ * Functions defined by the script are not looked into: the first rule
+ * calling one, like check() in tests/2.js, ends the compiled rules.
+ */
+struct rules;
+
+enum {
+    RULES_MATCH,   /* A rule matched, or none and the script then returns
+                      a constant: that is the answer. */
+    RULES_MISS,    /* No rule matched: run the rest of the script. */
+    RULES_UNKNOWN, /* Can't tell natively: run the whole script. */
+};
+
+/*
+ * Compile the leading rules of FindProxyForURL() in js. Returns NULL if
+ * there are none, or the script might not behave as assumed (e.g. it
+ * redefines the helpers). Otherwise, *rewritten is set to a version of js
+ * whose FindProxyForURL() skips the compiled rules when passed true as an
+ * extra third argument; run that one on RULES_MISS.
+ */
+struct rules *rules_compile(const char *js, char **rewritten);
+void rules_free(struct rules *rules);
+
+/* Whether the rules need what myIpAddress() returns. */
+int rules_use_my_ip(const struct rules *rules);
+
+/*
+ * Evaluate the rules for a lookup, with my_ip as myIpAddress(), or NULL
+ * if the rules don't use it. On RULES_MATCH, *result is set to the
+ * answer, which stays valid until rules_free().
+ */
+int rules_eval(const struct rules *rules, const char *url, const char *host,
+               const char *my_ip, const char **result);
@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "suffix.h"
+
+/*
+ * All edges and partial labels of the trie live in one hash table, keyed
+ * by the node they hang off, and the label. Labels are hashed from their
+ * end, so that the hashes of all suffixes of a label come out of a single
+ * pass over it, the last one being that of the whole label.
+ */
+struct entry {
+    unsigned int hash;
+    unsigned int node;
+    int partial; /* Partial label ending a suffix, or edge to a child. */
+    char *label; /* NULL if the slot is free. */
+    size_t len;
+    int value;   /* Lowest value of the suffix, or the child node. */
+};
+
+struct suffix_trie {
+    struct entry *table;
+    unsigned int size; /* Power of two. */
+    unsigned int used;
+    unsigned int nodes;
+    unsigned long partial_lens; /* Bit n: partial labels n long exist. */
+};
+
+#define INITIAL_SIZE 64
+#define LEN_BIT(n) (1ul << ((n) < 31 ? (n) : 31))
+#define FNV_PRIME 16777619u
+
+static unsigned int seed(unsigned int node)
+{
+    return (2166136261u ^ node) * FNV_PRIME;
+}
+
+static unsigned int step(unsigned int h, char c)
+{
+    return (h ^ (unsigned char)c) * FNV_PRIME;
+}
+
+static unsigned int hash_label(unsigned int node, const char *label,
+                               size_t len)
+{
+    unsigned int h = seed(node);
+
+    while (len)
+        h = step(h, label[--len]);
+
+    return h;
+}
+
+/* Last dot in s, or NULL. */
+static const char *last_dot(const char *s, size_t len)
+{
+    while (len)
+        if (s[--len] == '.')
+            return s + len;
+    return NULL;
+}
+
+static struct entry *find(const struct suffix_trie *trie, unsigned int hash,
+                          unsigned int node, int partial, const char *label,
+                          size_t len)
+{
+    unsigned int i, mask = trie->size - 1;
+    struct entry *e;
+
+    for (i = hash & mask;; i = (i + 1) & mask) {
+        e = &trie->table[i];
+        if (!e->label)
+            return e;
+        if (e->hash == hash && e->node == node && e->partial == partial &&
+            e->len == len && !memcmp(e->label, label, len))
+            return e;
+    }
+}
+
+static int grow(struct suffix_trie *trie)
+{
+    struct suffix_trie bigger = *trie;
+    unsigned int i;
+
+    bigger.size = trie->size ? trie->size * 2 : INITIAL_SIZE;
+    bigger.table = calloc(bigger.size, sizeof(struct entry));
+    if (!bigger.table)
+        return -1;
+
+    for (i = 0; i < trie->size; i++) {
+        struct entry *e = &trie->table[i];
+        if (e->label)
+            *find(&bigger, e->hash, e->node, e->partial, e->label,
+                  e->len) = *e;
+    }
+
+    free(trie->table);
+    *trie = bigger;
+
+    return 0;
+}
+
+/* The entry for a label, added with value if missing. */
+static struct entry *add(struct suffix_trie *trie, unsigned int node,
+                         int partial, const char *label, size_t len,
+                         int value)
+{
+    unsigned int hash = hash_label(node, label, len);
+    struct entry *e;
+
+    if (2 * (trie->used + 1) > trie->size && grow(trie) < 0)
+        return NULL;
+
+    e = find(trie, hash, node, partial, label, len);
+    if (e->label)
+        return e;
+
+    /* Not NULL, even for an empty label. */
+    e->label = malloc(len + 1);
+    if (!e->label)
+        return NULL;
+    memcpy(e->label, label, len);
+    e->hash = hash;
+    e->node = node;
+    e->partial = partial;
+    e->len = len;
+    e->value = value;
+    trie->used++;
+
+    return e;
+}
+
+struct suffix_trie *suffix_trie_create(void)
+{
+    struct suffix_trie *trie = calloc(1, sizeof(struct suffix_trie));
+
+    if (trie && grow(trie) < 0) {
+        free(trie);
+        return NULL;
+    }
+    if (trie)
+        trie->nodes = 1; /* The root. */
+
+    return trie;
+}
+
+void suffix_trie_free(struct suffix_trie *trie)
+{
+    unsigned int i;
+
+    if (!trie)
+        return;
+
+    for (i = 0; i < trie->size; i++)
+        free(trie->table[i].label);
+    free(trie->table);
+    free(trie);
+}
+
+int suffix_trie_add(struct suffix_trie *trie, const char *suffix, size_t len,
+                    int value)
+{
+    unsigned int node = 0;
+    const char *dot;
+    struct entry *e;
+
+    /* Whole labels, from the right. */
+    while ((dot = last_dot(suffix, len))) {
+        e = add(trie, node, 0, dot + 1, suffix + len - dot - 1, trie->nodes);
+        if (!e)
+            return -1;
+        if (e->value == (int)trie->nodes)
+            trie->nodes++;
+        node = e->value;
+        len = dot - suffix;
+    }
+
+    e = add(trie, node, 1, suffix, len, value);
+    if (!e)
+        return -1;
+    if (value < e->value)
+        e->value = value;
+    trie->partial_lens |= LEN_BIT(len);
+
+    return 0;
+}
+
+int suffix_trie_match(const struct suffix_trie *trie, const char *s,
+                      size_t len)
+{
+    unsigned int node = 0, h;
+    const char *label, *dot;
+    const struct entry *e;
+    size_t i, n;
+    int best = -1;
+
+    for (;;) {
+        dot = last_dot(s, len);
+        label = dot ? dot + 1 : s;
+        n = s + len - label;
+
+        /* Partial labels: the suffixes of this label, shortest first. */
+        h = seed(node);
+        for (i = 0;; i++) {
+            if (trie->partial_lens & LEN_BIT(i)) {
+                e = find(trie, h, node, 1, label + n - i, i);
+                if (e->label && (best < 0 || e->value < best))
+                    best = e->value;
+            }
+            if (i == n)
+                break;
+            h = step(h, label[n - i - 1]);
+        }
+
+        /* Down the edge of the whole label, if there is more to the left. */
+        if (!dot)
+            break;
+        e = find(trie, h, node, 0, label, n);
+        if (!e->label)
+            break;
+        node = e->value;
+        len = dot - s;
+    }
+
+    return best;
+}
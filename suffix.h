@@ -0,0 +1,23 @@
+/*
+ * Set of domain suffixes, as tested by dnsDomainIs(): a trie of labels,
+ * from the top level domain down. Each suffix is a path of whole labels
+ * plus, at its end, a possibly partial leftmost label ("example" in
+ * "example.com", which also matches "myexample.com"; empty in
+ * ".example.com"). A lookup walks the labels of the host from the right
+ * once, checking the partial labels stored along the way via hashing.
+ */
+struct suffix_trie;
+
+struct suffix_trie *suffix_trie_create(void);
+void suffix_trie_free(struct suffix_trie *trie);
+
+/*
+ * Add a suffix with a value, e.g. the index of the rule it comes from.
+ * Adding the same suffix again keeps the lower value.
+ */
+int suffix_trie_add(struct suffix_trie *trie, const char *suffix, size_t len,
+                    int value);
+
+/* Lowest value of the suffixes s ends with, or -1 if none. */
+int suffix_trie_match(const struct suffix_trie *trie, const char *s,
+                      size_t len);
@@ -0,0 +1,518 @@
+// Benchmark PAC: a few hundred address ranges, checked with isInNet().
+// Used by "make bench" in this directory.
+
+function FindProxyForURL(url, host) {
+    if (isInNet(host, "10.0.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.37.11.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.74.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.111.33.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.148.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.185.55.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.222.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.3.77.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.40.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.77.99.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.114.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.151.121.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.188.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.225.143.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.6.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.43.165.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.80.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.117.187.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.154.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.191.209.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.228.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.9.231.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.46.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.83.253.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.120.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.157.19.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.194.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.231.41.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.12.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.49.63.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.86.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.123.85.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.160.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.197.107.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.234.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.15.129.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.52.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.89.151.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.126.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.163.173.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.200.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.237.195.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.18.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.55.217.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.92.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.129.239.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.166.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.203.5.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.240.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.21.27.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.58.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.95.49.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.132.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.169.71.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.206.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.243.93.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "10.24.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "10.61.115.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "10.98.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "10.135.137.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "10.172.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "10.209.159.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "10.246.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "10.27.181.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.64.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.101.203.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.138.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.175.225.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.212.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.249.247.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.30.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.67.13.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.104.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.141.35.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.178.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.215.57.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.252.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.33.79.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.70.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.107.101.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.144.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.181.123.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.218.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.255.145.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.36.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.73.167.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.110.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.147.189.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.184.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.221.211.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.2.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.39.233.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.76.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.113.255.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.150.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.187.21.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.224.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.5.43.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.42.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.79.65.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.116.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.153.87.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.190.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.227.109.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.8.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.45.131.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.82.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.119.153.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.156.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.193.175.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.230.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.11.197.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.48.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.85.219.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.122.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.159.241.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.196.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.233.7.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.14.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.51.29.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "11.88.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "11.125.51.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "11.162.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "11.199.73.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "11.236.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "11.17.95.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "11.54.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "11.91.117.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.128.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.165.139.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.202.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.239.161.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.20.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.57.183.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.94.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.131.205.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.168.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.205.227.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.242.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.23.249.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.60.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.97.15.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.134.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.171.37.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.208.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.245.59.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.26.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.63.81.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.100.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.137.103.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.174.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.211.125.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.248.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.29.147.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.66.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.103.169.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.140.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.177.191.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.214.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.251.213.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.32.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.69.235.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.106.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.143.1.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.180.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.217.23.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.254.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.35.45.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.72.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.109.67.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.146.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.183.89.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.220.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.1.111.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.38.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.75.133.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.112.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.149.155.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.186.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.223.177.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.4.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.41.199.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.78.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.115.221.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "12.152.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "12.189.243.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "12.226.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "12.7.9.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "12.44.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "12.81.31.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "12.118.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "12.155.53.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.192.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.229.75.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.10.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.47.97.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.84.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.121.119.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.158.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.195.141.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.232.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.13.163.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.50.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.87.185.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.124.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.161.207.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.198.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.235.229.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.16.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.53.251.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.90.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.127.17.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.164.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.201.39.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.238.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.19.61.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.56.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.93.83.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.130.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.167.105.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.204.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.241.127.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.22.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.59.149.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.96.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.133.171.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.170.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.207.193.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.244.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.25.215.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.62.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.99.237.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.136.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.173.3.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.210.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.247.25.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.28.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.65.47.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.102.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.139.69.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.176.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.213.91.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.250.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.31.113.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.68.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.105.135.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.142.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.179.157.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    if (isInNet(host, "13.216.0.0", "255.255.0.0"))
+        return "PROXY proxy0.example.com:3128";
+    if (isInNet(host, "13.253.179.0", "255.255.255.0"))
+        return "PROXY proxy1.example.com:3128";
+    if (isInNet(host, "13.34.0.0", "255.255.240.0"))
+        return "PROXY proxy2.example.com:3128";
+    if (isInNet(host, "13.71.201.128", "255.255.255.128"))
+        return "PROXY proxy3.example.com:3128";
+    if (isInNet(host, "13.108.0.0", "255.255.0.0"))
+        return "PROXY proxy4.example.com:3128";
+    if (isInNet(host, "13.145.223.0", "255.255.255.0"))
+        return "PROXY proxy5.example.com:3128";
+    if (isInNet(host, "13.182.0.0", "255.255.240.0"))
+        return "PROXY proxy6.example.com:3128";
+    if (isInNet(host, "13.219.245.128", "255.255.255.128"))
+        return "PROXY proxy7.example.com:3128";
+    return "DIRECT";
+}
@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+#include <sys/resource.h>
+#endif
+
+#include "pac.h"
+
+/*
+ * Benchmark lookups against a PAC file: evaluates the given URL/host pairs
+ * round-robin on one context, via pac_find_proxy_blocking(), and reports
+ * the throughput. Options select engine settings to compare.
+ */
+
+static void usage(char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-a] [-H] [-r] [-n <lookups>] <PAC file> <URL> <host> "
+            "[<URL> <host> ...]\n"
+            "  -a  per-context arena allocator\n"
+            "  -H  huge pages for the arena allocator\n"
+            "  -n  number of lookups (default: 100000)\n"
+            "  -r  compile the leading rules of FindProxyForURL()\n",
+            prog);
+    fflush(stderr);
+    exit(1);
+}
+
+static char *read_pacfile(char *pacfile)
+{
+    char *js = NULL;
+    size_t js_sz = 8192, offset = 0;
+    int rc, fd = open(pacfile, O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file %s\n", pacfile);
+        return NULL;
+    }
+
+    js = calloc(1, js_sz);
+    while (js) {
+        rc = read(fd, js + offset, js_sz - offset - 1);
+        if (rc <= 0)
+            break;
+        offset += rc;
+        if (offset == js_sz - 1) {
+            js_sz *= 2;
+            js = realloc(js, js_sz);
+        }
+    }
+    close(fd);
+
+    if (!js || rc < 0) {
+        fprintf(stderr, "Error reading PAC file %s\n", pacfile);
+        free(js);
+        return NULL;
+    }
+    js[offset] = '\0';
+
+    return js;
+}
+
+static struct pac_mem_stats last_ms;
+static unsigned long long total_allocs;
+
+static void mem_stats(const struct pac_mem_stats *ms, void *arg)
+{
+    last_ms = *ms;
+    total_allocs += ms->allocs;
+}
+
+static double now_s(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    struct pac_opts opts;
+    struct pac *pac;
+    char *js, *proxy;
+    long i, n = 100000;
+    int c, n_pairs;
+    double start, elapsed;
+
+    pac_opts_init(&opts);
+    opts.sync_contexts = 1;
+
+    while ((c = getopt(argc, argv, "aHn:r")) != -1) {
+        switch (c) {
+        case 'a':
+            opts.arena = 1;
+            opts.mem_stats_cb = mem_stats;
+            break;
+        case 'H':
+            opts.huge_pages = 1;
+            break;
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'r':
+            opts.compile_rules = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 3 || argc % 2 != 1 || n <= 0)
+        usage(argv[-optind]);
+    n_pairs = (argc - 1) / 2;
+
+    js = read_pacfile(argv[0]);
+    if (!js)
+        return 1;
+
+    start = now_s();
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    if (!pac) {
+        fprintf(stderr, "Failed to initialize PAC\n");
+        return 1;
+    }
+    elapsed = now_s() - start;
+    printf("init: %.3f ms\n", elapsed * 1e3);
+
+    start = now_s();
+    for (i = 0; i < n; i++) {
+        c = i % n_pairs;
+        if (pac_find_proxy_blocking(pac, argv[1 + 2 * c], argv[2 + 2 * c],
+                                    &proxy) < 0) {
+            fprintf(stderr, "Lookup failed\n");
+            return 1;
+        }
+        free(proxy);
+    }
+    elapsed = now_s() - start;
+    printf("lookups: %ld in %.3f s, %.0f/s, %.2f us each\n", n, elapsed,
+           n / elapsed, elapsed * 1e6 / n);
+
+    if (opts.arena)
+        printf("heap: %lu bytes live, %lu peak, %lu in chunks, "
+               "%.1f allocations per lookup\n",
+               last_ms.bytes_live, last_ms.bytes_peak, last_ms.heap_bytes,
+               (double)total_allocs / n);
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+    {
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0)
+            printf("max RSS: %ld kB\n", ru.ru_maxrss);
+    }
+#endif
+
+    pac_free(pac);
+    free(js);
+
+    return 0;
+}
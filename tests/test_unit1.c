@@ -1,9 +1,29 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "greatest.h"
 
 #include "pac.h"
+#include "rom.h"
 
 SUITE(suite);
 
+/* Freed after each test, also when one of its assertions fails. */
+static struct pac *test_pac;
+
+static void free_test_pac(void *arg)
+{
+    if (test_pac)
+        pac_free(test_pac);
+    test_pac = NULL;
+}
+
 TEST pac_init_valid_js(void)
 {
     char *js = "function FindProxyForURL(u, h) { return \"DIRECT\"; }";
@@ -22,10 +42,1462 @@ TEST pac_init_invalid_js(void)
     PASS();
 }
 
+static char *found_proxy;
+static int n_found;
+
+static void proxy_found(char *proxy, void *arg)
+{
+    free(found_proxy);
+    found_proxy = proxy;
+    n_found++;
+}
+
+/* Run callbacks until n results arrived, or give up after ~5 seconds. */
+static int wait_found(struct pac *pac, int n)
+{
+    int i;
+
+    for (i = 0; i < 500 && n_found < n; i++) {
+        usleep(10000);
+        pac_run_callbacks(pac);
+    }
+
+    return n_found >= n;
+}
+
+#if defined(CPU_SET)
+/* The CPUs the thread evaluating a lookup may run on, and runs on. */
+static cpu_set_t worker_cpus;
+static int worker_cpu;
+
+static void record_cpu(const struct pac_mem_stats *ms, void *arg)
+{
+    pthread_getaffinity_np(pthread_self(), sizeof(worker_cpus),
+                           &worker_cpus);
+    worker_cpu = sched_getcpu();
+}
+
+TEST pac_init_pinned(void)
+{
+    char *js = "function FindProxyForURL(u, h) { return \"DIRECT\"; }";
+    int cpus[] = { CPU_SETSIZE - 1 };
+    cpu_set_t allowed;
+    struct pac_opts opts;
+    struct pac *pac;
+
+    /* The last CPU we may use, so that pinning makes a difference. */
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+    while (cpus[0] > 0 && !CPU_ISSET(cpus[0], &allowed))
+        cpus[0]--;
+
+    pac_opts_init(&opts);
+    opts.cpus = cpus;
+    opts.n_cpus = 1;
+    opts.mem_stats_cb = record_cpu;
+
+    pac = test_pac = pac_init_opts(js, 2, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    CPU_ZERO(&worker_cpus);
+    worker_cpu = -1;
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com", proxy_found,
+                                NULL));
+    ASSERT(wait_found(pac, 1));
+    ASSERT_STR_EQ("DIRECT", found_proxy);
+
+    ASSERT_EQ(1, CPU_COUNT(&worker_cpus));
+    ASSERT(CPU_ISSET(cpus[0], &worker_cpus));
+    ASSERT_EQ(cpus[0], worker_cpu);
+
+    PASS();
+}
+#endif
+
+/* Takes a while, so that submissions pile up in the queue. */
+static char *slow_js =
+    "function FindProxyForURL(u, h) {"
+    "    for (var i = 0; i < 200000; i++) {}"
+    "    return \"PROXY slow:8080\";"
+    "}";
+
+TEST pac_queue_limit_rejects(void)
+{
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    int i, rejected = 0;
+
+    pac_opts_init(&opts);
+    opts.queue_limit = 1;
+
+    pac = test_pac = pac_init_opts(slow_js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    for (i = 0; i < 20; i++) {
+        char host[16];
+        snprintf(host, sizeof(host), "h%d.com", i);
+        if (pac_find_proxy(pac, "http://a.com/", host, proxy_found,
+                           NULL) < 0) {
+            ASSERT_EQ(EAGAIN, errno);
+            rejected++;
+        }
+    }
+    ASSERT(rejected > 0);
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(rejected, stats.rejected);
+    ASSERT_EQ(0, stats.shed);
+
+    ASSERT(wait_found(pac, 20 - rejected));
+
+    PASS();
+}
+
+TEST pac_queue_limit_sheds(void)
+{
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    int i;
+
+    pac_opts_init(&opts);
+    opts.queue_limit = 1;
+    opts.fallback = "DIRECT";
+
+    pac = test_pac = pac_init_opts(slow_js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    for (i = 0; i < 20; i++) {
+        char host[16];
+        snprintf(host, sizeof(host), "h%d.com", i);
+        ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", host,
+                                    proxy_found, NULL));
+    }
+
+    pac_get_stats(pac, &stats);
+    ASSERT(stats.shed > 0);
+    ASSERT_EQ(0, stats.rejected);
+
+    ASSERT(wait_found(pac, 20));
+
+    PASS();
+}
+
+TEST pac_dns_lane(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    if (h == \"localhost\") dnsResolve(h);"
+               "    return \"DIRECT\";"
+               "}";
+    struct pac_opts opts;
+    struct pac_req_opts ro;
+    struct pac_stats stats;
+    struct pac *pac;
+
+    pac_opts_init(&opts);
+    opts.dns_threads = 1;
+
+    pac = test_pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    /* Nothing is known about the host yet, so it goes to the fast lane. */
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://localhost/", "localhost",
+                                proxy_found, NULL));
+    ASSERT(wait_found(pac, 1));
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(0, stats.dns_lane);
+
+    /* It resolved a name, so the next lookup for it is DNS-bound. */
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://localhost/", "localhost",
+                                proxy_found, NULL));
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com",
+                                proxy_found, NULL));
+    ASSERT(wait_found(pac, 3));
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(1, stats.dns_lane);
+
+    /* Callers can override the guess. */
+    pac_req_opts_init(&ro);
+    ro.lane = PAC_LANE_DNS;
+    ASSERT_EQ(0, pac_find_proxy_ex(pac, "http://a.com/", "a.com", &ro,
+                                   proxy_found, NULL));
+    ASSERT(wait_found(pac, 4));
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(2, stats.dns_lane);
+    ASSERT_STR_EQ("DIRECT", found_proxy);
+
+    PASS();
+}
+
+static char *endless_js =
+    "function FindProxyForURL(u, h) {"
+    "    if (h == \"loop\") for (;;) {}"
+    "    return \"DIRECT\";"
+    "}";
+
+TEST pac_deadline_interrupts(void)
+{
+    struct pac_req_opts ro;
+    struct pac_stats stats;
+    struct pac *pac = test_pac = pac_init(endless_js, 1, NULL, NULL);
+    ASSERT(pac != NULL);
+
+    pac_req_opts_init(&ro);
+    ro.timeout_ms = 50;
+
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy_ex(pac, "http://loop/", "loop", &ro,
+                                   proxy_found, NULL));
+    ASSERT(wait_found(pac, 1));
+    ASSERT(found_proxy == NULL);
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(1, stats.expired);
+
+    /* The context is still usable afterwards. */
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com",
+                                proxy_found, NULL));
+    ASSERT(wait_found(pac, 2));
+    ASSERT_STR_EQ("DIRECT", found_proxy);
+
+    PASS();
+}
+
+TEST pac_cancel_running(void)
+{
+    struct pac_req_opts ro;
+    struct pac_stats stats;
+    struct pac *pac = test_pac = pac_init(endless_js, 1, NULL, NULL);
+    ASSERT(pac != NULL);
+
+    pac_req_opts_init(&ro);
+
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy_ex(pac, "http://loop/", "loop", &ro,
+                                   proxy_found, NULL));
+    ASSERT(ro.handle != 0);
+    /* Queued behind the endless lookup. */
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com",
+                                proxy_found, NULL));
+
+    usleep(20000);
+    ASSERT_EQ(0, pac_cancel(pac, ro.handle));
+    ASSERT_EQ(-1, pac_cancel(pac, ro.handle));
+
+    /* Only the second lookup calls back. */
+    ASSERT(wait_found(pac, 1));
+    ASSERT_STR_EQ("DIRECT", found_proxy);
+    usleep(20000);
+    pac_run_callbacks(pac);
+    ASSERT_EQ(1, n_found);
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(1, stats.cancelled);
+
+    PASS();
+}
+
+TEST pac_coalesce_identical(void)
+{
+    char *js = "var n = 0;"
+               "function FindProxyForURL(u, h) {"
+               "    n++;"
+               "    for (var i = 0; i < 200000; i++) {}"
+               "    return \"PROXY p\" + n + \":8080\";"
+               "}";
+    struct pac_stats stats;
+    struct pac *pac = test_pac = pac_init(js, 1, NULL, NULL);
+    int i;
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    for (i = 0; i < 5; i++)
+        ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com",
+                                    proxy_found, NULL));
+    ASSERT(wait_found(pac, 5));
+
+    /* All five got the result of the first and only evaluation. */
+    ASSERT_STR_EQ("PROXY p1:8080", found_proxy);
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(4, stats.coalesced);
+
+    PASS();
+}
+
+TEST pac_blocking_lookup(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    return h == \"a.com\" ? \"DIRECT\" : \"PROXY p:8080\";"
+               "}";
+    struct pac_opts opts;
+    struct pac *pac;
+    char *proxy = NULL;
+    int i;
+
+    pac_opts_init(&opts);
+    opts.sync_contexts = 1;
+
+    pac = test_pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                             &proxy));
+        ASSERT_STR_EQ("DIRECT", proxy);
+        free(proxy);
+    }
+
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://b.com/", "b.com",
+                                         &proxy));
+    ASSERT_STR_EQ("PROXY p:8080", proxy);
+    free(proxy);
+
+    PASS();
+}
+
+TEST pac_reload_script(void)
+{
+    char *js_a = "function FindProxyForURL(u, h) { return \"PROXY a\"; }";
+    char *js_b = "function FindProxyForURL(u, h) { return \"PROXY b\"; }";
+    struct pac *pac;
+    char *proxy = NULL;
+
+    pac = pac_init(js_a, 2, NULL, NULL);
+    ASSERT(pac != NULL);
+
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                         &proxy));
+    ASSERT_STR_EQ("PROXY a", proxy);
+    free(proxy);
+
+    ASSERT_EQ(0, pac_reload(pac, js_b));
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                         &proxy));
+    ASSERT_STR_EQ("PROXY b", proxy);
+    free(proxy);
+
+    /* A broken script is refused, and the previous one stays. */
+    ASSERT_EQ(-1, pac_reload(pac, "function FindProxyForURL(u, h) {"));
+    ASSERT_EQ(EINVAL, errno);
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                         &proxy));
+    ASSERT_STR_EQ("PROXY b", proxy);
+    free(proxy);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+static char *reload_found[2];
+
+static void reload_proxy_found(char *proxy, void *arg)
+{
+    reload_found[(long)arg] = proxy;
+    n_found++;
+}
+
+TEST pac_reload_inflight(void)
+{
+    char *js_old = "function FindProxyForURL(u, h) {"
+                   "    for (var i = 0; i < 2000000; i++) {}"
+                   "    return \"PROXY old:8080\";"
+                   "}";
+    char *js_new = "function FindProxyForURL(u, h) {"
+                   "    return \"PROXY new:8080\";"
+                   "}";
+    struct pac *pac;
+
+    pac = pac_init(js_old, 1, NULL, NULL);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com",
+                                reload_proxy_found, (void *)0L));
+    usleep(10000);
+    ASSERT_EQ(0, pac_reload(pac, js_new));
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com",
+                                reload_proxy_found, (void *)1L));
+
+    ASSERT(wait_found(pac, 2));
+    ASSERT_STR_EQ("PROXY old:8080", reload_found[0]);
+    ASSERT_STR_EQ("PROXY new:8080", reload_found[1]);
+    free(reload_found[0]);
+    free(reload_found[1]);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+static int n_ready;
+
+static void pool_ready(void *arg)
+{
+    n_ready++;
+}
+
+/* Run callbacks until the pool became ready n times, or give up. */
+static int wait_ready(struct pac *pac, int n)
+{
+    int i;
+
+    for (i = 0; i < 500 && n_ready < n; i++) {
+        usleep(10000);
+        pac_run_callbacks(pac);
+    }
+
+    return n_ready >= n;
+}
+
+TEST pac_warm_up(void)
+{
+    char *js_a = "function FindProxyForURL(u, h) { return \"PROXY a\"; }";
+    char *js_b = "function FindProxyForURL(u, h) { return \"PROXY b\"; }";
+    struct pac_opts opts;
+    struct pac *pac;
+
+    pac_opts_init(&opts);
+    opts.ready_cb = pool_ready;
+    n_ready = 0;
+
+    pac = pac_init_opts(js_a, 8, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    /* Served right away, whether or not all contexts exist yet. */
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com", proxy_found,
+                                NULL));
+    ASSERT(wait_found(pac, 1));
+    ASSERT_STR_EQ("PROXY a", found_proxy);
+    ASSERT(wait_ready(pac, 1));
+
+    ASSERT_EQ(0, pac_reload(pac, js_b));
+    ASSERT(wait_ready(pac, 2));
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com", proxy_found,
+                                NULL));
+    ASSERT(wait_found(pac, 2));
+    ASSERT_STR_EQ("PROXY b", found_proxy);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+static void script_proxy_found(char *proxy, void *arg)
+{
+    reload_found[(long)arg] = proxy;
+    n_found++;
+}
+
+/* Look up a.com with script id, and wait for the result. */
+static char *find_with_script(struct pac *pac, const char *id)
+{
+    struct pac_req_opts ro;
+
+    pac_req_opts_init(&ro);
+    ro.script_id = id;
+    reload_found[0] = NULL;
+    n_found = 0;
+    if (pac_find_proxy_ex(pac, "http://a.com/", "a.com", &ro,
+                          script_proxy_found, (void *)0L) < 0)
+        return NULL;
+    wait_found(pac, 1);
+
+    return reload_found[0];
+}
+
+TEST pac_multiple_scripts(void)
+{
+    char *js[] = {
+        "function FindProxyForURL(u, h) { return \"PROXY a\"; }",
+        "function FindProxyForURL(u, h) { return \"PROXY b\"; }",
+        "function FindProxyForURL(u, h) { return \"PROXY c\"; }",
+    };
+    const char *ids[] = { "a", "b", "c" };
+    char expected[] = "PROXY a";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *proxy;
+    int i, j;
+
+    pac_opts_init(&opts);
+    opts.max_contexts = 2;
+
+    /* No default script: lookups have to name one. */
+    pac = pac_init_opts(NULL, 2, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+    for (i = 0; i < 3; i++)
+        ASSERT_EQ(0, pac_add_script(pac, ids[i], js[i]));
+    ASSERT_EQ(-1, pac_add_script(pac, "d", "function FindProxyForURL("));
+
+    for (j = 0; j < 3; j++) {
+        for (i = 0; i < 3; i++) {
+            proxy = find_with_script(pac, ids[i]);
+            expected[6] = 'a' + i;
+            ASSERT(proxy != NULL);
+            ASSERT_STR_EQ(expected, proxy);
+            free(proxy);
+        }
+    }
+
+    /* Three scripts took turns on two contexts. */
+    pac_get_stats(pac, &stats);
+    ASSERT(stats.evicted > 0);
+
+    ASSERT(find_with_script(pac, NULL) == NULL);
+    ASSERT(find_with_script(pac, "d") == NULL);
+    ASSERT_EQ(ENOENT, errno);
+
+    ASSERT_EQ(0, pac_remove_script(pac, "b"));
+    ASSERT(find_with_script(pac, "b") == NULL);
+    ASSERT_EQ(-1, pac_remove_script(pac, "b"));
+    proxy = find_with_script(pac, "c");
+    ASSERT_STR_EQ("PROXY c", proxy);
+    free(proxy);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+TEST pac_exec_budget(void)
+{
+    char *js = "var n = 0;"
+               "function FindProxyForURL(u, h) {"
+               "    n++;"
+               "    if (h == \"loop\") for (;;) {}"
+               "    return \"PROXY p\" + n;"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *proxy = NULL;
+
+    pac_opts_init(&opts);
+    opts.max_exec_ms = 50;
+    opts.exec_fallback = "DIRECT";
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://loop/", "loop", proxy_found,
+                                NULL));
+    ASSERT(wait_found(pac, 1));
+    ASSERT_STR_EQ("DIRECT", found_proxy);
+
+    /* Served by a fresh context, with the script's globals reset. */
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "a.com", proxy_found,
+                                NULL));
+    ASSERT(wait_found(pac, 2));
+    ASSERT_STR_EQ("PROXY p1", found_proxy);
+
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://loop/", "loop",
+                                         &proxy));
+    ASSERT_STR_EQ("DIRECT", proxy);
+    free(proxy);
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(2, stats.over_budget);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+static struct pac_mem_stats last_mem_stats;
+
+static void mem_stats_cb(const struct pac_mem_stats *ms, void *arg)
+{
+    last_mem_stats = *ms;
+}
+
+TEST pac_arena_allocator(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    if (shExpMatch(h, \"*.a.com\")) return \"PROXY a\";"
+               "    return \"DIRECT\";"
+               "}";
+    struct pac_opts opts;
+    struct pac *pac;
+    char *proxy = NULL;
+    int i;
+
+    pac_opts_init(&opts);
+    opts.arena = 1;
+    opts.mem_stats_cb = mem_stats_cb;
+    opts.sync_contexts = 1;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    for (i = 0; i < 1000; i++) {
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://x.a.com/",
+                                             i % 2 ? "x.a.com" : "b.com",
+                                             &proxy));
+        ASSERT_STR_EQ(i % 2 ? "PROXY a" : "DIRECT", proxy);
+        free(proxy);
+    }
+
+    ASSERT(last_mem_stats.allocs > 0);
+    ASSERT(last_mem_stats.bytes_live > 0);
+    ASSERT(last_mem_stats.bytes_peak >= last_mem_stats.bytes_live);
+    ASSERT(last_mem_stats.heap_bytes > 0);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+TEST pac_gc_between_lookups(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    var a = {}, b = { a: a }; a.b = b;" /* A cycle. */
+               "    return \"DIRECT\";"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    int i;
+
+    pac_opts_init(&opts);
+    opts.gc_interval = 10;
+    opts.mem_stats_cb = mem_stats_cb;
+    memset(&last_mem_stats, 0, sizeof(last_mem_stats));
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    for (i = 0; i < 30; i++) {
+        char host[32];
+        snprintf(host, sizeof(host), "h%d.com", i);
+        ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", host, proxy_found,
+                                    NULL));
+        ASSERT(wait_found(pac, i + 1));
+    }
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(3, stats.gc_runs);
+    ASSERT_EQ(2, last_mem_stats.gc_count);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+TEST pac_gc_blocking(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    var a = {}, b = { a: a }; a.b = b;" /* A cycle. */
+               "    return \"DIRECT\";"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *proxy;
+    int i;
+
+    pac_opts_init(&opts);
+    opts.gc_interval = 10;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    for (i = 0; i < 30; i++) {
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                             &proxy));
+        ASSERT_STR_EQ("DIRECT", proxy);
+        free(proxy);
+    }
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(3, stats.gc_runs);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+TEST pac_heap_limit(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    var a = [];"
+               "    if (h == \"big\")"
+               "        for (var i = 0; i < 1000000; i++) a.push({ i: i });"
+               "    return \"DIRECT\";"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *proxy = NULL;
+
+    pac_opts_init(&opts);
+    opts.max_heap_bytes = 4 * 1024 * 1024;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://big/", "big", &proxy));
+    ASSERT(proxy == NULL);
+
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                         &proxy));
+    ASSERT_STR_EQ("DIRECT", proxy);
+    free(proxy);
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(1, stats.over_memory);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+/* A heap too small for the script: all threads are torn down again. */
+TEST pac_init_heap_too_small(void)
+{
+    char *js = "function FindProxyForURL(u, h) { return \"DIRECT\"; }";
+    struct pac_opts opts;
+
+    pac_opts_init(&opts);
+    opts.dns_threads = 1;
+    opts.resolver_threads = 1;
+    opts.max_heap_bytes = 1024;
+
+    ASSERT(pac_init_opts(js, 2, NULL, NULL, &opts) == NULL);
+
+    PASS();
+}
+
+TEST pac_recycle_contexts(void)
+{
+    char *js = "var n = 0;"
+               "function FindProxyForURL(u, h) { return \"PROXY p\" + ++n; }";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    int i, n, max_n = 0;
+
+    pac_opts_init(&opts);
+    opts.recycle_after = 5;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    for (i = 0; i < 40; i++) {
+        char host[32];
+        snprintf(host, sizeof(host), "h%d.com", i);
+        ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", host, proxy_found,
+                                    NULL));
+        ASSERT(wait_found(pac, i + 1));
+        ASSERT(found_proxy != NULL);
+        n = atoi(found_proxy + strlen("PROXY p"));
+        if (n > max_n)
+            max_n = n;
+    }
+
+    /* Fresh contexts start counting from scratch. */
+    ASSERT(max_n < 20);
+    pac_get_stats(pac, &stats);
+    ASSERT(stats.recycled >= 2);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+/* Keeps the highest counter returned by the script below in *arg. */
+static void counter_found(char *proxy, void *arg)
+{
+    int *max_n = arg, n = proxy ? atoi(proxy + strlen("PROXY p")) : 0;
+
+    if (n > *max_n)
+        *max_n = n;
+    free(proxy);
+    n_found++;
+}
+
+TEST pac_recycle_concurrent(void)
+{
+    char *js = "var n = 0;"
+               "function FindProxyForURL(u, h) {"
+               "    for (var i = 0; i < 20000; i++) {}"
+               "    return \"PROXY p\" + ++n;"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    int i, max_n, round;
+
+    /* With room for replacements next to the contexts, and without. */
+    for (round = 0; round < 2; round++) {
+        pac_opts_init(&opts);
+        opts.recycle_after = 5;
+        opts.max_contexts = round == 0 ? 8 : 4;
+
+        pac = pac_init_opts(js, 4, NULL, NULL, &opts);
+        ASSERT(pac != NULL);
+
+        /* Waves of lookups running side by side on all contexts. */
+        n_found = 0;
+        max_n = 0;
+        for (i = 0; i < 800; i++) {
+            char host[32];
+            snprintf(host, sizeof(host), "h%d.com", i);
+            ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", host,
+                                        counter_found, &max_n));
+            if (i % 8 == 7)
+                ASSERT(wait_found(pac, i + 1));
+        }
+
+        /* No context got stuck serving on and on. */
+        ASSERT(max_n < 40);
+        pac_get_stats(pac, &stats);
+        ASSERT(stats.recycled >= 40);
+
+        pac_free(pac);
+    }
+
+    PASS();
+}
+
+/* Counts results differing from the expected one in arg. */
+static int n_wrong;
+
+static void proxy_checked(char *proxy, void *arg)
+{
+    if (!proxy || strcmp(proxy, arg))
+        n_wrong++;
+    free(proxy);
+    n_found++;
+}
+
+TEST pac_park_on_dns(void)
+{
+    char *js = "function FindProxyForURL(u, h) {"
+               "    if (h == 'native')"
+               "        return ['localhost'].map(dnsResolve)[0];"
+               "    return dnsResolve('localhost') + ';' +"
+               "           isInNet('localhost', '127.0.0.0', '255.0.0.0');"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *expected, *expected_native;
+    int i;
+
+    /* Same script without coroutines. */
+    ASSERT_EQ(0, pac_find_proxy_sync(js, "http://a.com/", "a.com", &expected));
+    ASSERT_EQ(0, pac_find_proxy_sync(js, "http://a.com/", "native",
+                                     &expected_native));
+
+    pac_opts_init(&opts);
+    opts.resolver_threads = 2;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    n_found = 0;
+    n_wrong = 0;
+    for (i = 0; i < 20; i++) {
+        char url[32];
+        snprintf(url, sizeof(url), "http://a.com/%d", i);
+        ASSERT_EQ(0, pac_find_proxy(pac, url, "a.com", proxy_checked,
+                                    expected));
+    }
+    /* Can't yield across map(): waits for the answer instead. */
+    ASSERT_EQ(0, pac_find_proxy(pac, "http://a.com/", "native",
+                                proxy_checked, expected_native));
+    ASSERT(wait_found(pac, 21));
+    ASSERT_EQ(0, n_wrong);
+
+    pac_get_stats(pac, &stats);
+    ASSERT(stats.parked > 0);
+
+    pac_free(pac);
+    free(expected);
+    free(expected_native);
+
+    PASS();
+}
+
+TEST pac_compiled_rules(void)
+{
+    char *js = "function FindProxyForURL(url, host) {\n"
+               "    var lhost = host.toLowerCase();\n"
+               "    // Internal\n"
+               "    if (isPlainHostName(host) || host == 'localhost')\n"
+               "        return 'DIRECT';\n"
+               "    if (dnsDomainIs(lhost, '.example.com') &&\n"
+               "        !shExpMatch(lhost, '(www|ftp).*'))\n"
+               "        return 'PROXY inner:3128';\n"
+               "    if (shExpMatch(host, '(*.org|*.net)')) {\n"
+               "        return 'PROXY org:3128';\n"
+               "    }\n"
+               "    if (url.substring(0, 4) == 'ftp:' ||\n"
+               "        url.indexOf('/download/') != -1)\n"
+               "        return 'PROXY files:3128';\n"
+               "    if (isInNet(host, '10.0.0.0', '255.0.0.0'))\n"
+               "        return 'PROXY ten:3128';\n"
+               "    if (lhost.indexOf('.test') >= 0)\n"
+               "        return 'PROXY test:3128';\n"
+               "    var n = lhost.length;\n"
+               "    return 'PROXY rest:' + n;\n"
+               "}";
+    static const char *lookups[][2] = {
+        {"http://intranet/", "intranet"},
+        {"http://localhost/", "localhost"},
+        {"http://a.example.com/", "a.example.com"},
+        {"http://A.EXAMPLE.COM/", "A.EXAMPLE.COM"},
+        {"http://www.example.com/", "www.example.com"},
+        {"http://b.org/", "b.org"},
+        {"http://b.org.uk/", "b.org.uk"},
+        {"ftp://c.com/", "c.com"},
+        {"http://c.com/download/x", "c.com"},
+        {"http://10.1.2.3/", "10.1.2.3"},
+        {"http://300.1.2.3/", "300.1.2.3"},
+        {"http://11.1.2.3/", "11.1.2.3"},
+        {"http://a.test.com/", "a.test.com"},
+        {"http://localhost.test/", "localhost.test"},
+        {"http://other.com/", "other.com"},
+    };
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *expected, *proxy;
+    unsigned int i;
+
+    pac_opts_init(&opts);
+    opts.compile_rules = 1;
+    opts.sync_contexts = 1;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    for (i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+        char *url = (char *)lookups[i][0], *host = (char *)lookups[i][1];
+        ASSERT_EQ(0, pac_find_proxy_sync(js, url, host, &expected));
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, url, host, &proxy));
+        ASSERT(proxy != NULL);
+        ASSERT_STR_EQ(expected, proxy);
+        free(expected);
+        free(proxy);
+    }
+
+    pac_get_stats(pac, &stats);
+    ASSERT(stats.rule_hits >= 8);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+TEST pac_compiled_rules_redefined(void)
+{
+    char *js = "function dnsDomainIs(h, d) { return true; }\n"
+               "function FindProxyForURL(url, host) {\n"
+               "    if (dnsDomainIs(host, '.example.com'))\n"
+               "        return 'PROXY p:3128';\n"
+               "    return 'DIRECT';\n"
+               "}";
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *proxy;
+
+    pac_opts_init(&opts);
+    opts.compile_rules = 1;
+
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a.com/", "a.com",
+                                         &proxy));
+    ASSERT_STR_EQ("PROXY p:3128", proxy);
+    free(proxy);
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(0, stats.rule_hits);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+/* A script generated by the tests below, grown as needed. */
+struct script {
+    char *js;
+    size_t len, size;
+};
+
+static void script_add(struct script *s, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        abort();
+
+    if (s->len + n + 1 > s->size) {
+        s->size = 2 * (s->len + n + 1);
+        s->js = realloc(s->js, s->size);
+        if (!s->js)
+            abort();
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(s->js + s->len, s->size - s->len, fmt, ap);
+    va_end(ap);
+    s->len += n;
+}
+
+/*
+ * Load js with compile_rules, check that it answers the hosts as the
+ * script itself does, and that rule_hits of them were answered natively.
+ * Returns -1 (with the failed assertion recorded) otherwise.
+ */
+static int check_compiled(char *js, const char **hosts, unsigned int n_hosts,
+                          unsigned long rule_hits)
+{
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+    char *proxy, *want;
+    unsigned int i;
+
+    pac_opts_init(&opts);
+    opts.compile_rules = 1;
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    for (i = 0; i < n_hosts; i++) {
+        ASSERT_EQ(0, pac_find_proxy_sync(js, "http://a/", (char *)hosts[i],
+                                         &want));
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a/",
+                                             (char *)hosts[i], &proxy));
+        ASSERT(proxy != NULL);
+        ASSERT_STR_EQ(want, proxy);
+        free(want);
+        free(proxy);
+    }
+
+    pac_get_stats(pac, &stats);
+    ASSERT_EQ(rule_hits, stats.rule_hits);
+
+    pac_free(pac);
+
+    return 0;
+}
+
+/* "!" binds tighter than "==": these compare !host, and aren't compiled. */
+TEST pac_compiled_rules_not(void)
+{
+    static const char *hosts[] = {"a.com", "b.com", "zz.com"};
+    char eq[] = "function FindProxyForURL(url, host) {\n"
+                "    if (!host == 'a.com')\n"
+                "        return 'PROXY x';\n"
+                "    return 'DIRECT';\n"
+                "}";
+    char index[] = "function FindProxyForURL(url, host) {\n"
+                   "    if (!host.indexOf('zz') >= 0)\n"
+                   "        return 'PROXY x';\n"
+                   "    return 'DIRECT';\n"
+                   "}";
+
+    if (check_compiled(eq, hosts, 3, 0) < 0 ||
+        check_compiled(index, hosts, 3, 0) < 0)
+        return -1;
+
+    PASS();
+}
+
+TEST pac_domain_lists(void)
+{
+    char *js = "var corp = dnsDomainSet(['.corp.example.com', 'example.org',"
+               "                         '.example.com', 'le.org']);\n"
+               "function FindProxyForURL(url, host) {\n"
+               "    return 'PROXY p' + corp.match(host);\n"
+               "}";
+    static const char *expected[][2] = {
+        {"a.corp.example.com", "PROXY p0"},
+        {"corp.example.com", "PROXY p2"},
+        {"example.com", "PROXY p-1"},
+        {"www.example.org", "PROXY p1"},
+        {"myexample.org", "PROXY p1"},
+        {"sample.org", "PROXY p3"},
+        {"example.org.uk", "PROXY p-1"},
+    };
+    static const char *hosts[] = {"a.d7.com", "d8.com", "a.d8.com",
+                                  "xd8.com", "a.d499.com", "a.d1.com",
+                                  "d7.com", "d1.com", "d500.com",
+                                  "d7.com.au", "com", ""};
+    struct script big = {NULL, 0, 0};
+    struct pac *pac;
+    unsigned int i;
+    char *proxy;
+
+    pac = pac_init(js, 1, NULL, NULL);
+    ASSERT(pac != NULL);
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a/",
+                                             (char *)expected[i][0], &proxy));
+        ASSERT(proxy != NULL);
+        ASSERT_STR_EQ(expected[i][1], proxy);
+        free(proxy);
+    }
+    pac_free(pac);
+
+    /*
+     * A long chain of dnsDomainIs() rules goes into one trie. The last six
+     * hosts match no rule, and run the rest of the script (not a constant,
+     * see pac_proven_misses).
+     */
+    script_add(&big, "function FindProxyForURL(url, host) {\n");
+    for (i = 0; i < 500; i++)
+        script_add(&big, "    if (dnsDomainIs(host, '%sd%u.com'))\n"
+                         "        return 'PROXY p%u';\n",
+                   i % 2 ? "." : "", i, i);
+    script_add(&big, "    return 'DIRECT' + '';\n}\n");
+
+    if (check_compiled(big.js, hosts, sizeof(hosts) / sizeof(hosts[0]),
+                       6) < 0)
+        return -1;
+    free(big.js);
+
+    PASS();
+}
+
+TEST pac_substring_sets(void)
+{
+    char *js = "var terms = substringSet(['wiley', 'ebsco', 'ley.c', 'Co'],"
+               "                         true);\n"
+               "var exact = substringSet(['Co', '']);\n"
+               "function FindProxyForURL(url, host) {\n"
+               "    return 'PROXY p' + terms.match(host) + exact.match(url);\n"
+               "}";
+    static const char *expected[][2] = {
+        {"www.wiley.com", "PROXY p01"},
+        {"search.EBSCOhost.com", "PROXY p11"},
+        {"ley.com", "PROXY p21"},
+        {"ley.org", "PROXY p-11"},
+        {"a.co", "PROXY p31"},
+    };
+    static const char *hosts[] = {"www.t7.com", "T14.org", "at700.t0.com",
+                                  "t2093.t21.net", "t7", "t8.com", "t1.com",
+                                  ""};
+    struct script big = {NULL, 0, 0};
+    struct pac *pac;
+    unsigned int i;
+    char *proxy;
+
+    pac = pac_init(js, 1, NULL, NULL);
+    ASSERT(pac != NULL);
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a/",
+                                             (char *)expected[i][0], &proxy));
+        ASSERT(proxy != NULL);
+        ASSERT_STR_EQ(expected[i][1], proxy);
+        free(proxy);
+    }
+    ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://Co/", "x", &proxy));
+    ASSERT_STR_EQ("PROXY p-10", proxy);
+    free(proxy);
+    pac_free(pac);
+
+    /*
+     * A chain of indexOf() rules goes into one automaton. The last four
+     * hosts match no rule.
+     */
+    script_add(&big, "function FindProxyForURL(url, host) {\n"
+                     "    var h = host.toLowerCase();\n");
+    for (i = 0; i < 300; i++)
+        script_add(&big, "    if (h.indexOf('t%u.') >= 0)\n"
+                         "        return 'PROXY p%u';\n", i * 7, i);
+    script_add(&big, "    return 'DIRECT' + '';\n}\n");
+
+    if (check_compiled(big.js, hosts, sizeof(hosts) / sizeof(hosts[0]),
+                       4) < 0)
+        return -1;
+    free(big.js);
+
+    PASS();
+}
+
+TEST pac_ip_range_sets(void)
+{
+    char *js = "var nets = ipRangeSet(['10.0.0.0/8', '10.1.0.0/16',"
+               "                       '192.168.1.7', '2001:db8::/32',"
+               "                       '0.0.0.0/0']);\n"
+               "function FindProxyForURL(url, host) {\n"
+               "    return 'PROXY p' + nets.match(host);\n"
+               "}";
+    static const char *expected[][2] = {
+        {"10.1.2.3", "PROXY p0"},
+        {"192.168.1.7", "PROXY p2"},
+        {"192.168.1.8", "PROXY p4"},
+        {"2001:db8:1::5", "PROXY p3"},
+        {"2001:db9::5", "PROXY p-1"},
+        {"::ffff:10.0.0.1", "PROXY p0"},
+        {"a.com", "PROXY p-1"},
+    };
+    static const char *hosts[] = {"10.3.3.1", "10.3.200.1", "10.4.4.9",
+                                  "10.49.199.1", "10.7.3.1", "10.9.9.8",
+                                  "10.99.1.2", "300.3.3.1"};
+    struct script big = {NULL, 0, 0};
+    struct pac *pac;
+    unsigned int i;
+    char *proxy;
+
+    pac = pac_init(js, 1, NULL, NULL);
+    ASSERT(pac != NULL);
+    for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a/",
+                                             (char *)expected[i][0], &proxy));
+        ASSERT(proxy != NULL);
+        ASSERT_STR_EQ(expected[i][1], proxy);
+        free(proxy);
+    }
+    pac_free(pac);
+
+    ASSERT(pac_init("var x = ipRangeSet(['10.0.0.0/33']);"
+                    "function FindProxyForURL(u, h) { return 'DIRECT'; }",
+                    1, NULL, NULL) == NULL);
+
+    /*
+     * A chain of isInNet() rules goes into one tree. The last two hosts
+     * match no rule.
+     */
+    script_add(&big, "function FindProxyForURL(url, host) {\n");
+    for (i = 0; i < 200; i++)
+        script_add(&big, "    if (isInNet(host, '10.%u.%u.0', '%s'))\n"
+                         "        return 'PROXY p%u';\n",
+                   i % 50, i, i % 3 ? "255.255.255.0" : "255.255.0.0", i);
+    script_add(&big, "    if (isInNet(host, '10.0.0.1', '255.0.0.255'))\n"
+                     "        return 'PROXY odd';\n"
+                     "    return 'DIRECT' + '';\n}\n");
+
+    if (check_compiled(big.js, hosts, sizeof(hosts) / sizeof(hosts[0]),
+                       6) < 0)
+        return -1;
+    free(big.js);
+
+    PASS();
+}
+
+TEST pac_exact_hosts(void)
+{
+    static const char *hosts[] = {"h6.example.com", "H8.EXAMPLE.COM",
+                                  "www7", "www9.example", "www9.example.com",
+                                  "h298.example.com", "www7.example.org",
+                                  "h7.example.co", "h7", "www8", ""};
+    struct script big = {NULL, 0, 0};
+    unsigned int i;
+
+    /*
+     * Long lists of == and localHostOrDomainIs() go into one hash table.
+     * The last five hosts match no rule.
+     */
+    script_add(&big, "function FindProxyForURL(url, host) {\n"
+                     "    var h = host.toLowerCase();\n");
+    for (i = 0; i < 300; i++) {
+        if (i % 2)
+            script_add(&big, "    if (localHostOrDomainIs(host, "
+                             "'www%u.example.com'))\n",
+                       i);
+        else
+            script_add(&big, "    if (h == 'h%u.example.com')\n", i);
+        script_add(&big, "        return 'PROXY p%u';\n", i);
+    }
+    script_add(&big, "    return 'DIRECT' + '';\n}\n");
+
+    if (check_compiled(big.js, hosts, sizeof(hosts) / sizeof(hosts[0]),
+                       6) < 0)
+        return -1;
+    free(big.js);
+
+    PASS();
+}
+
+TEST pac_proven_misses(void)
+{
+    static const char *hosts[] = {"a.d7.com", "D8.COM", "h9.net", "d7.com.au",
+                                  "h9.net.au", "x.org", ""};
+    struct script big = {NULL, 0, 0};
+    unsigned int i, j;
+
+    /*
+     * With a constant after the rules, lookups that match none (most of
+     * them proven so by the filter) don't run the script either. The last
+     * four hosts match no rule, so only the constant answers them.
+     */
+    for (j = 0; j < 2; j++) {
+        big.len = 0;
+        script_add(&big, "function FindProxyForURL(url, host) {\n"
+                         "    var h = host.toLowerCase();\n");
+        for (i = 0; i < 200; i++)
+            script_add(&big, "    if (dnsDomainIs(h, '.d%u.com') || "
+                             "h == 'd%u.com' || host == 'h%u.net')\n"
+                             "        return 'PROXY p%u';\n",
+                       i, i, i, i);
+        script_add(&big, j ? "    return 'DIRECT' + '';\n}\n"
+                           : "    return 'DIRECT';\n}\n");
+
+        if (check_compiled(big.js, hosts, sizeof(hosts) / sizeof(hosts[0]),
+                           j ? 3 : 7) < 0)
+            return -1;
+    }
+    free(big.js);
+
+    PASS();
+}
+
+TEST pac_my_ip_rules(void)
+{
+    char *js = "function FindProxyForURL(url, host) {\n"
+               "    if (isInNet(myIpAddress(), '0.0.0.0', '0.0.0.0') &&\n"
+               "        dnsDomainIs(host, '.a.com'))\n"
+               "        return 'PROXY mine';\n"
+               "    if (isInNet(myIpAddress(), '0.0.0.1',\n"
+               "                '255.255.255.255'))\n"
+               "        return 'PROXY never';\n"
+               "    return 'DIRECT';\n"
+               "}";
+    static const char *hosts[] = {"x.a.com", "x.b.com"};
+    char *proxy, *want, *ip;
+    unsigned int i, a, b, c, d;
+    struct pac_opts opts;
+    struct pac_stats stats;
+    struct pac *pac;
+
+    pac_opts_init(&opts);
+    opts.compile_rules = 1;
+    opts.my_ip_ttl_ms = 10000;
+    pac = pac_init_opts(js, 1, NULL, NULL, &opts);
+    ASSERT(pac != NULL);
+
+    for (i = 0; i < 4; i++) {
+        char *host = (char *)hosts[i % 2];
+        ASSERT_EQ(0, pac_find_proxy_sync(js, "http://a/", host, &want));
+        ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a/", host, &proxy));
+        ASSERT(proxy != NULL);
+        ASSERT_STR_EQ(want, proxy);
+        free(want);
+        free(proxy);
+        pac_network_changed();
+    }
+
+    /* Answered natively, unless this host has no IPv4 address. */
+    ASSERT_EQ(0, pac_find_proxy_sync("function FindProxyForURL(u, h) {"
+                                     "    return myIpAddress(); }",
+                                     "http://a/", "a", &ip));
+    pac_get_stats(pac, &stats);
+    if (sscanf(ip, "%u.%u.%u.%u", &a, &b, &c, &d) == 4)
+        ASSERT_EQ(4, stats.rule_hits);
+    free(ip);
+
+    pac_free(pac);
+
+    PASS();
+}
+
+#ifdef PAC_ROM_PAC
+TEST pac_rom_script(void)
+{
+    static const char *hosts[] = {"abcdomain.com", "a.local", "10.1.2.3",
+                                  "google.com"};
+    struct pac_opts opts;
+    struct pac *pac;
+    unsigned int i, j;
+    char *proxy, *want;
+
+    pac_opts_init(&opts);
+    opts.rom_script = 1;
+
+    for (j = 0; j < 2; j++) {
+        opts.compile_rules = j;
+        pac = pac_init_opts(NULL, 1, NULL, NULL, &opts);
+        ASSERT(pac != NULL);
+        for (i = 0; i < sizeof(hosts) / sizeof(hosts[0]); i++) {
+            ASSERT_EQ(0, pac_find_proxy_sync((char *)pac_rom.javascript,
+                                             "http://a/", (char *)hosts[i],
+                                             &want));
+            ASSERT_EQ(0, pac_find_proxy_blocking(pac, "http://a/",
+                                                 (char *)hosts[i], &proxy));
+            ASSERT(proxy != NULL);
+            ASSERT_STR_EQ(want, proxy);
+            free(want);
+            free(proxy);
+        }
+        pac_free(pac);
+    }
+
+    PASS();
+}
+#else
+TEST pac_rom_script(void)
+{
+    struct pac_opts opts;
+
+    /* Not built in. */
+    pac_opts_init(&opts);
+    opts.rom_script = 1;
+    ASSERT(pac_init_opts(NULL, 1, NULL, NULL, &opts) == NULL);
+    ASSERT_EQ(ENOENT, errno);
+
+    PASS();
+}
+#endif
+
 GREATEST_SUITE(suite)
 {
+    SET_TEARDOWN(free_test_pac, NULL);
+
     RUN_TEST(pac_init_valid_js);
     RUN_TEST(pac_init_invalid_js);
+#if defined(CPU_SET)
+    RUN_TEST(pac_init_pinned);
+#endif
+    RUN_TEST(pac_queue_limit_rejects);
+    RUN_TEST(pac_queue_limit_sheds);
+    RUN_TEST(pac_dns_lane);
+    RUN_TEST(pac_deadline_interrupts);
+    RUN_TEST(pac_cancel_running);
+    RUN_TEST(pac_coalesce_identical);
+    RUN_TEST(pac_blocking_lookup);
+    RUN_TEST(pac_reload_script);
+    RUN_TEST(pac_reload_inflight);
+    RUN_TEST(pac_warm_up);
+    RUN_TEST(pac_multiple_scripts);
+    RUN_TEST(pac_exec_budget);
+    RUN_TEST(pac_arena_allocator);
+    RUN_TEST(pac_gc_between_lookups);
+    RUN_TEST(pac_gc_blocking);
+    RUN_TEST(pac_heap_limit);
+    RUN_TEST(pac_init_heap_too_small);
+    RUN_TEST(pac_recycle_contexts);
+    RUN_TEST(pac_recycle_concurrent);
+    RUN_TEST(pac_park_on_dns);
+    RUN_TEST(pac_compiled_rules);
+    RUN_TEST(pac_compiled_rules_redefined);
+    RUN_TEST(pac_compiled_rules_not);
+    RUN_TEST(pac_domain_lists);
+    RUN_TEST(pac_substring_sets);
+    RUN_TEST(pac_ip_range_sets);
+    RUN_TEST(pac_exact_hosts);
+    RUN_TEST(pac_proven_misses);
+    RUN_TEST(pac_my_ip_rules);
+    RUN_TEST(pac_rom_script);
 }
 
 GREATEST_MAIN_DEFS();
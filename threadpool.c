@@ -21,6 +21,7 @@ THE SOFTWARE.
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 #include <time.h>
@@ -118,7 +119,11 @@ typedef struct threadpool_queue {
 
 struct threadpool {
     int maxthreads, threads, idle;
+    /* CPUs threads get pinned to, and the number of threads on each. */
+    int *cpus, *cpu_threads, ncpus;
     threadpool_queue_t scheduled, scheduled_back;
+    /* Length of scheduled, and its limit (0 if unbounded). */
+    int queued, maxqueued;
     /* Set when we request that all threads die. */
     int dying;
     /* If this is false, we are guaranteed that scheduled_back is empty. */
@@ -133,6 +138,11 @@ struct threadpool {
     void *wakeup_closure;
 };
 
+typedef struct threadpool_thread {
+    threadpool_t *threadpool;
+    int cpu;                    /* index into cpus, or -1 */
+} threadpool_thread_t;
+
 threadpool_t *
 threadpool_create(int maxthreads,
                   threadpool_func_t *wakeup, void *wakeup_closure)
@@ -152,6 +162,63 @@ threadpool_create(int maxthreads,
     return tp;
 }
 
+int
+threadpool_set_affinity(threadpool_t *threadpool, const int *cpus, int ncpus)
+{
+#if defined(CPU_SET)
+    int *c, *t;
+
+    c = malloc(ncpus * sizeof(int));
+    t = calloc(ncpus, sizeof(int));
+    if(c == NULL || t == NULL) {
+        free(c);
+        free(t);
+        return -1;
+    }
+    memcpy(c, cpus, ncpus * sizeof(int));
+
+    pthread_mutex_lock(&threadpool->lock);
+    /* Threads already running keep their old index; don't let them
+       account into the new array. */
+    if(threadpool->threads > 0) {
+        pthread_mutex_unlock(&threadpool->lock);
+        free(c);
+        free(t);
+        errno = EBUSY;
+        return -1;
+    }
+    free(threadpool->cpus);
+    free(threadpool->cpu_threads);
+    threadpool->cpus = c;
+    threadpool->cpu_threads = t;
+    threadpool->ncpus = ncpus;
+    pthread_mutex_unlock(&threadpool->lock);
+    return 1;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void
+threadpool_set_max_queued(threadpool_t *threadpool, int maxqueued)
+{
+    pthread_mutex_lock(&threadpool->lock);
+    threadpool->maxqueued = maxqueued;
+    pthread_mutex_unlock(&threadpool->lock);
+}
+
+int
+threadpool_queued(threadpool_t *threadpool)
+{
+    int queued;
+
+    pthread_mutex_lock(&threadpool->lock);
+    queued = threadpool->queued;
+    pthread_mutex_unlock(&threadpool->lock);
+    return queued;
+}
+
 int
 threadpool_die(threadpool_t *threadpool, int canblock)
 {
@@ -192,6 +259,8 @@ threadpool_destroy(threadpool_t *threadpool)
     pthread_cond_destroy(&threadpool->cond);
     pthread_cond_destroy(&threadpool->die_cond);
     pthread_mutex_destroy(&threadpool->lock);
+    free(threadpool->cpus);
+    free(threadpool->cpu_threads);
     free(threadpool);
     return 1;
 }
@@ -212,9 +281,10 @@ threadpool_dequeue(threadpool_queue_t *queue)
 }
 
 static void *
-thread_main(void *pool)
+thread_main(void *arg)
 {
-    threadpool_t *threadpool = pool;
+    threadpool_thread_t *self = arg;
+    threadpool_t *threadpool = self->threadpool;
     threadpool_item_t *item;
     threadpool_func_t *func;
     void *closure;
@@ -248,6 +318,7 @@ thread_main(void *pool)
     }
 
     item = threadpool_dequeue(&threadpool->scheduled);
+    threadpool->queued--;
     pthread_mutex_unlock(&threadpool->lock);
 
     func = item->func;
@@ -259,8 +330,11 @@ thread_main(void *pool)
 
  die:
     threadpool->threads--;
+    if(self->cpu >= 0)
+        threadpool->cpu_threads[self->cpu]--;
     pthread_cond_broadcast(&threadpool->die_cond);
     pthread_mutex_unlock(&threadpool->lock);
+    free(self);
     return NULL;
 }
 
@@ -270,18 +344,43 @@ threadpool_new_thread(threadpool_t *threadpool)
 {
     pthread_t thread;
     pthread_attr_t attr;
+    threadpool_thread_t *self;
     int rc;
 
     assert(threadpool->threads < threadpool->maxthreads);
 
+    self = malloc(sizeof(threadpool_thread_t));
+    if(self == NULL)
+        return -1;
+    self->threadpool = threadpool;
+    self->cpu = -1;
+
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-    rc = pthread_create(&thread, &attr, thread_main, (void*)threadpool);
+#if defined(CPU_SET)
+    if(threadpool->ncpus > 0) {
+        cpu_set_t set;
+        int i;
+        self->cpu = 0;
+        for(i = 1; i < threadpool->ncpus; i++)
+            if(threadpool->cpu_threads[i] <
+               threadpool->cpu_threads[self->cpu])
+                self->cpu = i;
+        CPU_ZERO(&set);
+        CPU_SET(threadpool->cpus[self->cpu], &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+#endif
+    rc = pthread_create(&thread, &attr, thread_main, (void*)self);
+    pthread_attr_destroy(&attr);
     if(rc) {
+        free(self);
         errno = rc;
         return -1;
     }
     threadpool->threads++;
+    if(self->cpu >= 0)
+        threadpool->cpu_threads[self->cpu]++;
     return 1;
 }
 
@@ -329,15 +428,33 @@ threadpool_schedule(threadpool_t *threadpool,
         return -1;
 
     pthread_mutex_lock(&threadpool->lock);
-    threadpool_enqueue(&threadpool->scheduled, item);
+    if(threadpool->maxqueued > 0 &&
+       threadpool->queued >= threadpool->maxqueued) {
+        pthread_mutex_unlock(&threadpool->lock);
+        free(item);
+        errno = EAGAIN;
+        return -1;
+    }
     if(threadpool->idle == 0) {
         dosignal = 0;
         if(threadpool->threads < threadpool->maxthreads) {
             rc = threadpool_new_thread(threadpool);
-            if(rc < 0 && threadpool->threads > 0)
+            if(rc < 0 && threadpool->threads > 0) {
                 rc = 0;             /* we'll recover */
+            } else if(rc < 0) {
+                /* Nobody would ever run it.  Not EAGAIN, which callers
+                   take for a full queue. */
+                pthread_mutex_unlock(&threadpool->lock);
+                free(item);
+                errno = ENOMEM;
+                return -1;
+            }
         }
     }
+    /* A thread just created only waits for work after taking the lock,
+       so it finds the item without a signal. */
+    threadpool_enqueue(&threadpool->scheduled, item);
+    threadpool->queued++;
     if(dosignal)
         pthread_cond_signal(&threadpool->cond);
     pthread_mutex_unlock(&threadpool->lock);
@@ -30,6 +30,20 @@ threadpool_t *threadpool_create(int maxthreads,
                                 threadpool_func_t *wakeup,
                                 void *wakeup_closure);
 
+/* Pin the threads of a pool to a set of CPUs.  Every thread created
+   afterwards is bound to the CPU of the set running the fewest threads.
+   Returns -1 if thread affinity is not supported on this platform. */
+int threadpool_set_affinity(threadpool_t *threadpool,
+                            const int *cpus, int ncpus);
+
+/* Limit the number of pieces of work waiting for a thread.  Once the
+   limit is reached, threadpool_schedule fails with EAGAIN.  Zero (the
+   default) means unbounded. */
+void threadpool_set_max_queued(threadpool_t *threadpool, int maxqueued);
+
+/* Number of pieces of work waiting for a thread. */
+int threadpool_queued(threadpool_t *threadpool);
+
 /* Cause a thread pool to die.  Returns whenever there is new stuff in the
    callback queue, or immediately if canblock is false.  Returns true when
    the thread pool is dead. */
@@ -40,7 +54,8 @@ int threadpool_die(threadpool_t *threadpool, int canblock);
 int threadpool_destroy(threadpool_t *threadpool);
 
 /* Schedule a new piece of work for a thread pool.  Returns -1 if something
-   went wrong. */
+   went wrong, with errno set to EAGAIN if the queue is full, and ENOMEM if
+   no thread could be started to run it.  The work is not queued then. */
 int threadpool_schedule(threadpool_t *threadpool,
                          threadpool_func_t *func, void *closure);
 
@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 #if defined(_WIN32) || defined(__CYGWIN__)
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -14,6 +17,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <dirent.h>
 #endif
 
 #include "util.h"
@@ -251,3 +255,89 @@ out:
     return ret;
 }
 
+
+/* Milliseconds on a monotonic clock, for deadlines. */
+unsigned long long util_now_ms(void)
+{
+    return util_now_us() / 1000;
+}
+
+/* Microseconds on a monotonic clock, for measuring short pauses. */
+unsigned long long util_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Return the NUMA node a CPU belongs to, as exported by sysfs. Machines
+ * without NUMA information are treated as having a single node 0.
+ */
+int util_cpu_node(int cpu)
+{
+#if defined(__linux__)
+    char path[64];
+    DIR *dir;
+    struct dirent *de;
+    int node = 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (!dir)
+        return 0;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "node", 4) == 0 &&
+            sscanf(de->d_name + 4, "%d", &node) == 1)
+            break;
+    }
+
+    closedir(dir);
+    return node;
+#else
+    return 0;
+#endif
+}
+
+int util_current_cpu(void)
+{
+#if defined(CPU_SET)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Run fn() with the calling thread temporarily pinned to a CPU, so that
+ * memory first touched by fn() ends up on that CPU's NUMA node. The
+ * previous affinity mask is restored afterwards. If affinity is not
+ * supported, fn() still runs, and -1 is returned.
+ */
+int util_run_on_cpu(int cpu, void (*fn)(void *), void *arg)
+{
+#if defined(CPU_SET)
+    cpu_set_t saved, set;
+    pthread_t self = pthread_self();
+    int pinned = 0;
+
+    if (pthread_getaffinity_np(self, sizeof(saved), &saved) == 0) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pinned = pthread_setaffinity_np(self, sizeof(set), &set) == 0;
+    }
+
+    fn(arg);
+
+    if (pinned)
+        pthread_setaffinity_np(self, sizeof(saved), &saved);
+
+    return pinned ? 0 : -1;
+#else
+    fn(arg);
+    return -1;
+#endif
+}
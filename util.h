@@ -2,3 +2,8 @@
 
 int util_dns_resolve(const char *host, char *buf, size_t buflen, int all);
 int util_my_ip_address(char *buf, size_t buflen, int all);
+unsigned long long util_now_ms(void);
+unsigned long long util_now_us(void);
+int util_cpu_node(int cpu);
+int util_current_cpu(void);
+int util_run_on_cpu(int cpu, void (*fn)(void *), void *arg);